@@ -0,0 +1,810 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_FAST_PARSER
+#define DOM_PARSER_DOM_FAST_PARSER
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "DOMencoding.hpp"
+#include "DOMentities.hpp"
+#include "DOMinput.hpp"
+#include "DOMmappedTree.hpp"
+#include "DOMmarkup.hpp"
+#include "DOMprojection.hpp"
+#include "DOMtree.hpp"
+#include "DOMtreeBuilder.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Character classes used by fast_parser.
+     * */
+    struct char_class_values
+    {
+    public:
+        const static unsigned char C_NAMECHR = 0; // anything else, part of names and values
+        const static unsigned char C_WHSPACE = 1;
+        const static unsigned char C_OPENTAG = 2; // <
+        const static unsigned char C_CLOSTAG = 3; // >
+        const static unsigned char C_BKSLASH = 4; // /
+        const static unsigned char C_EQLSIGN = 5; // =
+        const static unsigned char C_QUOTE = 6;   // " or '
+    };
+
+    /**
+     *  @brief  Generates the character class table at compile time.
+     * */
+    constexpr std::array<unsigned char, 256> make_char_classes()
+    {
+        std::array<unsigned char, 256> table{};
+        for (auto &c : table)
+            c = char_class_values::C_NAMECHR;
+        table[' '] = table['\n'] = table['\t'] = char_class_values::C_WHSPACE;
+        table['\r'] = table['\v'] = table['\f'] = char_class_values::C_WHSPACE;
+        table['<'] = char_class_values::C_OPENTAG;
+        table['>'] = char_class_values::C_CLOSTAG;
+        table['/'] = char_class_values::C_BKSLASH;
+        table['='] = char_class_values::C_EQLSIGN;
+        table['\"'] = table['\''] = char_class_values::C_QUOTE;
+        return table;
+    }
+
+    /**
+     *  @brief  Byte offsets of a node in the UTF-8 input. For elements the
+     *          content lies between the end of the start tag and the start of
+     *          the end tag; self closing elements have content_begin past
+     *          content_end so that no offset is inside their content. For
+     *          inner-data nodes the range is the whole text run between tags,
+     *          CDATA sections, comments and processing instructions included.
+     * */
+    struct node_span
+    {
+        std::size_t begin;
+        std::size_t content_begin;
+        std::size_t content_end;
+        std::size_t end;
+    };
+
+    /**
+     *  @brief  Single pass parser working on the whole input held in memory.
+     *          Bytes are classified by a table generated at compile time and
+     *          element, attribute and text boundaries are handed straight to a
+     *          DOMtreeBuilder, no tokens are created in between. Produces the
+     *          same tree as lexer + DOMparser::_parser on well formed input.
+     * */
+    class fast_parser
+    {
+    private:
+        static constexpr std::array<unsigned char, 256> char_classes = make_char_classes();
+
+        std::string data;                        // the whole input, as UTF-8
+        const char *input = nullptr;              // start of the input being parsed
+        std::string scratch;                     // reused for text needing rewriting
+        std::string word;                        // a word of text with references to decode
+        bool space_pending = false;              // white space after the last text collected
+        std::vector<std::string_view> open_names; // names of the open elements
+        std::vector<int> open_steps;             // projection steps of the open elements
+        const projection *spec = nullptr;         // built paths, nullptr builds everything
+
+        // open_steps values besides the steps of the projection
+        const static int step_all = -1;  // whole subtree is built
+        const static int step_none = -2; // nothing below is built
+        std::vector<node_span> *spans = nullptr; // spans by node UID, recorded if set
+        std::vector<std::size_t> open_spans;      // spans of the open elements
+        DOMtreeBuilder builder;
+        bool fragment = false; // any number of top level nodes, text included
+        bool validate_utf8;
+        std::size_t error_at = 0;
+
+        static inline unsigned char cls(char c)
+        {
+            return char_classes[static_cast<unsigned char>(c)];
+        }
+
+        static inline const char *skip_space(const char *p, const char *end)
+        {
+            while (p < end && cls(*p) == char_class_values::C_WHSPACE)
+                ++p;
+            return p;
+        }
+
+        static inline const char *skip_name(const char *p, const char *end)
+        {
+            while (p < end && cls(*p) == char_class_values::C_NAMECHR)
+                ++p;
+            return p;
+        }
+
+        /**
+         *  @brief  Records the position of an error.
+         *  @return -2, the error value of DOMparser::loadTree
+         * */
+        inline int fail(const char *p)
+        {
+            error_at = p - input;
+            return -2;
+        }
+
+        /**
+         *  @brief  Appends the words of a text to scratch with references
+         *          decoded. Words are separated by one space where white space
+         *          separates them in the input, also across comments and
+         *          processing instructions.
+         * */
+        void collect_text(const char *p, const char *end)
+        {
+            while (true)
+            {
+                const char *start = skip_space(p, end);
+                space_pending |= (start != p);
+                if ((p = start) == end)
+                    break;
+                while (p < end && cls(*p) != char_class_values::C_WHSPACE)
+                    ++p;
+                if (space_pending && !scratch.empty())
+                    scratch += ' ';
+                space_pending = false;
+                if (std::memchr(start, '&', p - start) == nullptr)
+                    scratch.append(start, p - start);
+                else
+                {
+                    word.assign(start, p - start);
+                    decode_entities(word);
+                    scratch += word;
+                }
+            }
+        }
+
+        /**
+         *  @brief  Appends the content of a CDATA section to scratch as it is,
+         *          after one space if white space comes before the section.
+         * */
+        inline void collect_cdata(const char *p, const char *end)
+        {
+            if (space_pending && !scratch.empty())
+                scratch += ' ';
+            space_pending = false;
+            scratch.append(p, end - p);
+        }
+
+        /**
+         *  @brief  Adds the text collected in scratch. White space only text
+         *          outside of CDATA sections is dropped.
+         *  @return true if a node was added
+         * */
+        template <typename Builder>
+        bool emit_text(Builder &out)
+        {
+            if (scratch.empty())
+                return false;
+            out.text(std::string_view(scratch));
+            return true;
+        }
+
+        /**
+         *  @brief  Adds an attribute, the value is used as it is unless it
+         *          contains references to be decoded.
+         * */
+        template <typename Builder>
+        inline void emit_attribute(Builder &out, std::string_view name, std::string_view value)
+        {
+            if (value.find('&') == std::string_view::npos)
+            {
+                out.attr(name, value);
+                return;
+            }
+            scratch.assign(value.data(), value.size());
+            decode_entities(scratch);
+            out.attr(name, std::string_view(scratch));
+        }
+
+        /**
+         *  @brief  Finds the end of a tag with quoted values in it.
+         *  @param  p   position inside the tag
+         *  @return position after '>', nullptr if data ends first
+         * */
+        static inline const char *skip_tag(const char *p, const char *end)
+        {
+            while (p < end)
+            {
+                unsigned char c = cls(*p);
+                if (c == char_class_values::C_CLOSTAG)
+                    return p + 1;
+                if (c == char_class_values::C_QUOTE)
+                {
+                    p = static_cast<const char *>(std::memchr(p + 1, *p, end - p - 1));
+                    if (p == nullptr)
+                        return nullptr;
+                }
+                ++p;
+            }
+            return nullptr;
+        }
+
+        /**
+         *  @brief  Skips a comment, a processing instruction, a CDATA section
+         *          or a declaration such as <!DOCTYPE>.
+         *  @param  p   position of the '<' starting it
+         *  @return position after it, p if there is none at p, nullptr if
+         *          data ends before it does
+         * */
+        static const char *skip_markup(const char *p, const char *end)
+        {
+            if (end - p < 2)
+                return p;
+            const char *at;
+            if (p[1] == '?')
+                return (at = find_marker(p + 2, end, "?>")) ? at + 2 : nullptr;
+            if (p[1] != '!')
+                return p;
+            std::string_view rest(p, end - p);
+            if (rest.substr(0, 4) == "<!--")
+                return (at = find_marker(p + 4, end, "-->")) ? at + 3 : nullptr;
+            if (rest.substr(0, 9) == "<![CDATA[")
+                return (at = find_marker(p + 9, end, "]]>")) ? at + 3 : nullptr;
+            return declaration_end(p + 2, end);
+        }
+
+        /**
+         *  @brief  Checks for the start of a CDATA section.
+         * */
+        static inline bool is_cdata(const char *p, const char *end)
+        {
+            return end - p >= 9 && std::memcmp(p, "<![CDATA[", 9) == 0;
+        }
+
+        /**
+         *  @brief  Checks for a comment or a processing instruction, which
+         *          text runs continue across.
+         * */
+        static inline bool is_ignored(const char *p, const char *end)
+        {
+            return end - p >= 2 && (p[1] == '?' || (end - p >= 4 && std::memcmp(p, "<!--", 4) == 0));
+        }
+
+        /**
+         *  @brief  Skips an element with its subtree by counting depth, nothing
+         *          inside is parsed or stored.
+         *  @param  p   position after the tag name of the element
+         *  @return position after the element, nullptr if data ends first
+         * */
+        static const char *skip_element(const char *p, const char *end)
+        {
+            p = skip_tag(p, end);
+            if (p == nullptr)
+                return nullptr;
+            if (p[-2] == '/') // self closing
+                return p;
+
+            std::size_t depth = 1;
+            while (depth != 0)
+            {
+                p = static_cast<const char *>(std::memchr(p, '<', end - p));
+                if (p == nullptr)
+                    return nullptr;
+                const char *after = skip_markup(p, end);
+                if (after != p)
+                {
+                    if (after == nullptr)
+                        return nullptr;
+                    p = after;
+                    continue;
+                }
+                if (++p == end)
+                    return nullptr;
+                bool closing = (*p == '/');
+                p = skip_tag(p, end);
+                if (p == nullptr)
+                    return nullptr;
+                if (closing)
+                    --depth;
+                else if (p[-2] != '/')
+                    ++depth;
+            }
+            return p;
+        }
+
+        /**
+         *  @brief  Runs the parser over the input.
+         *  @param  out     DOMtreeBuilder, DOMmappedTree or DOMschemaTree
+         *                  receiving the nodes
+         *  @param  begin   start of the UTF-8 input
+         *  @param  end     end of the UTF-8 input
+         *  @return 0 on success, -2 on error
+         * */
+        template <typename Builder>
+        int run(Builder &out, const char *begin, const char *end)
+        {
+            const char *p = input = begin;
+            bool root_closed = false;
+            open_names.clear();
+            open_steps.clear();
+            open_spans.clear();
+
+            p = skip_space(p, end);
+            if (!fragment && (p == end || *p != '<'))
+                return fail(p); // root node required
+
+            while (p < end)
+            {
+                if (*p != '<' || is_cdata(p, end)) // text
+                {
+                    const char *lt = (*p == '<') ? p : static_cast<const char *>(std::memchr(p, '<', end - p));
+                    if (lt == nullptr)
+                        lt = end;
+                    if (open_names.empty() && !fragment)
+                    {
+                        if (lt == p || skip_space(p, lt) != lt)
+                            return fail(p); // text outside of the root
+                        p = lt;
+                        continue;
+                    }
+
+                    // the text continues across CDATA sections, taken as they
+                    // are, comments and processing instructions
+                    const char *text = p;
+                    bool wanted = open_steps.empty() || open_steps.back() == step_all;
+                    scratch.clear();
+                    space_pending = false;
+                    while (true)
+                    {
+                        if (wanted)
+                            collect_text(p, lt);
+                        p = lt;
+                        if (is_cdata(p, end))
+                        {
+                            const char *close = find_marker(p + 9, end, "]]>");
+                            if (close == nullptr)
+                                return fail(p);
+                            if (wanted)
+                                collect_cdata(p + 9, close);
+                            p = close + 3;
+                        }
+                        else if (!is_ignored(p, end))
+                            break;
+                        else if ((p = skip_markup(p, end)) == nullptr)
+                            return fail(lt);
+                        lt = static_cast<const char *>(std::memchr(p, '<', end - p));
+                        if (lt == nullptr)
+                            lt = end;
+                    }
+                    if (wanted && emit_text(out) && spans != nullptr)
+                        spans->push_back({std::size_t(text - input), std::size_t(text - input),
+                                          std::size_t(p - input), std::size_t(p - input)});
+                    continue;
+                }
+                const char *after = skip_markup(p, end); // comment, processing instruction, declaration
+                if (after != p)
+                {
+                    if (after == nullptr)
+                        return fail(p);
+                    p = after;
+                    continue;
+                }
+
+                const char *tag_start = p++; // '<'
+                if (p < end && *p == '/') // closing tag
+                {
+                    const char *name = ++p;
+                    p = skip_name(p, end);
+                    std::string_view tag_name(name, p - name);
+                    p = skip_space(p, end);
+                    if (p == end || *p != '>' || open_names.empty() || open_names.back() != tag_name)
+                        return fail(p);
+                    ++p;
+                    open_names.pop_back();
+                    open_steps.pop_back();
+                    out.close();
+                    if (spans != nullptr)
+                    {
+                        node_span &span = (*spans)[open_spans.back()];
+                        span.content_end = tag_start - input;
+                        span.end = p - input;
+                        open_spans.pop_back();
+                    }
+                    root_closed = open_names.empty();
+                    continue;
+                }
+
+                // opening tag
+                if (root_closed && !fragment)
+                    return fail(p); // only one root allowed
+                const char *name = p;
+                p = skip_name(p, end);
+                if (p == name)
+                    return fail(p);
+                std::string_view tag_name(name, p - name);
+
+                // step of the element in the projection
+                int at = step_all;
+                if (spec != nullptr && (open_steps.empty() || open_steps.back() != step_all))
+                {
+                    int parent = open_steps.empty() ? 0 : open_steps.back();
+                    at = (parent == step_none) ? -1 : spec->child(parent, tag_name);
+                    if (at == -1)
+                    {
+                        if (!open_steps.empty())
+                        {
+                            p = skip_element(p, end);
+                            if (p == nullptr)
+                                return fail(end);
+                            continue;
+                        }
+                        at = step_none; // the root is always built
+                    }
+                    else if (spec->whole(at))
+                        at = step_all;
+                }
+
+                out.open(tag_name);
+                open_names.push_back(tag_name);
+                open_steps.push_back(at);
+                if (spans != nullptr)
+                {
+                    open_spans.push_back(spans->size());
+                    std::size_t begin = tag_start - input;
+                    spans->push_back({begin, begin, begin, begin});
+                }
+
+                // attributes till the end of the tag
+                while (true)
+                {
+                    p = skip_space(p, end);
+                    if (p == end)
+                        return fail(p);
+
+                    unsigned char c = cls(*p);
+                    if (c == char_class_values::C_CLOSTAG)
+                    {
+                        ++p;
+                        if (spans != nullptr)
+                            (*spans)[open_spans.back()].content_begin = p - input;
+                        break;
+                    }
+                    if (c == char_class_values::C_BKSLASH) // self closing tag
+                    {
+                        ++p;
+                        if (p == end || *p != '>')
+                            return fail(p);
+                        ++p;
+                        open_names.pop_back();
+                        open_steps.pop_back();
+                        out.close();
+                        if (spans != nullptr)
+                        {
+                            node_span &span = (*spans)[open_spans.back()];
+                            span.content_begin = span.end = p - input; // no content
+                            open_spans.pop_back();
+                        }
+                        root_closed = open_names.empty();
+                        break;
+                    }
+                    if (c != char_class_values::C_NAMECHR)
+                        return fail(p);
+
+                    const char *attribute = p;
+                    p = skip_name(p, end);
+                    std::string_view attribute_name(attribute, p - attribute);
+                    bool wanted = (at == step_all ||
+                                   (at != step_none && spec->wants_attribute(at, attribute_name)));
+                    p = skip_space(p, end);
+                    if (p == end || *p != '=') // no value attribute
+                    {
+                        if (wanted)
+                            out.attr(attribute_name, std::string_view());
+                        continue;
+                    }
+                    p = skip_space(p + 1, end);
+                    if (p == end)
+                        return fail(p);
+
+                    const char *value = p;
+                    if (cls(*p) == char_class_values::C_QUOTE)
+                    {
+                        const char *quote = static_cast<const char *>(std::memchr(p + 1, *p, end - p - 1));
+                        if (quote == nullptr)
+                            return fail(p);
+                        if (wanted)
+                            emit_attribute(out, attribute_name, std::string_view(value + 1, quote - value - 1));
+                        p = quote + 1;
+                    }
+                    else
+                    {
+                        p = skip_name(p, end);
+                        if (p == value)
+                            return fail(p);
+                        if (wanted)
+                            emit_attribute(out, attribute_name, std::string_view(value, p - value));
+                    }
+                }
+            }
+
+            if (fragment ? !open_names.empty() : !root_closed)
+                return fail(p);
+            return 0;
+        }
+
+        /**
+         *  @brief  Reads the whole source into data as UTF-8.
+         *  @return false if the input is not valid in its encoding
+         * */
+        bool load(std::unique_ptr<input_source> &&source)
+        {
+            const std::size_t chunk = 1 << 16;
+            utf8_validator validator;
+            data.clear();
+
+            // first chunk decides the encoding
+            data.resize(chunk);
+            data.resize(source->read(&data[0], chunk));
+            std::size_t bom_length;
+            text_encoding encoding = detect_encoding(data.data(), data.size(), bom_length);
+            if (encoding != text_encoding::utf8)
+            {
+                source.reset(new transcoding_source(
+                    std::move(source), encoding, data.substr(bom_length)));
+                data.clear();
+            }
+            else
+            {
+                data.erase(0, bom_length);
+                if (validate_utf8 && !validator.validate(data.data(), data.size()))
+                    return false;
+            }
+
+            // the rest is validated chunk by chunk as it arrives
+            while (true)
+            {
+                std::size_t size = data.size();
+                data.resize(size + chunk);
+                std::size_t got = source->read(&data[size], chunk);
+                data.resize(size + got);
+                if (got == 0)
+                    break;
+                if (validate_utf8 && !validator.validate(data.data() + size, got))
+                    return false;
+            }
+            return !source->failed() && (!validate_utf8 || validator.finish());
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _validate_utf8  reject input which is not valid UTF-8
+         * */
+        fast_parser(bool _validate_utf8 = true)
+            : validate_utf8(_validate_utf8) {}
+
+        /**
+         *  @brief  Parses the input into the tree.
+         *  @param  source  source of the input
+         *  @param  tree    tree to be replaced by the parsed document
+         *  @return -2  error, tree is left untouched
+         *          0   if parsed successfully
+         * */
+        int parse(std::unique_ptr<input_source> &&source, DOMtree &tree)
+        {
+            return parse(std::move(source), tree, nullptr);
+        }
+
+        /**
+         *  @brief  Parses the input into the tree, building only the paths
+         *          requested by the projection and skipping everything else.
+         *  @param  source  source of the input
+         *  @param  tree    tree to be replaced by the parsed document
+         *  @param  _spec   paths to be built, nullptr to build everything
+         *  @return -2  error, tree is left untouched
+         *          0   if parsed successfully
+         * */
+        int parse(std::unique_ptr<input_source> &&source, DOMtree &tree, const projection *_spec)
+        {
+            spec = _spec;
+            if (!source->is_open())
+                return -2;
+            if (!load(std::move(source)))
+            {
+                error_at = data.size();
+                return -2;
+            }
+
+            int res = run(builder, data.data(), data.data() + data.size());
+            DOMtree parsed = builder.release();
+            if (res == 0)
+                tree = std::move(parsed);
+            return res;
+        }
+
+        /**
+         *  @brief  Parses the input into a tree of another kind, such as
+         *          DOMschemaTree, which offers the open, attr, text and close
+         *          calls of DOMtreeBuilder. The parser is instantiated for the
+         *          type of the tree.
+         *  @param  source  source of the input
+         *  @param  out     tree receiving the nodes, holding part of the
+         *                  document on error
+         *  @return -2  error
+         *          0   if parsed successfully
+         * */
+        template <typename Builder>
+        int parse_into(std::unique_ptr<input_source> &&source, Builder &out)
+        {
+            spec = nullptr;
+            if (!source->is_open())
+                return -2;
+            if (!load(std::move(source)))
+            {
+                error_at = data.size();
+                return -2;
+            }
+            return run(out, data.data(), data.data() + data.size());
+        }
+
+#ifdef DOM_PARSER_HAS_MMAP
+        /**
+         *  @brief  Parses a file into a memory mapped tree. The input is mapped
+         *          too, so neither the document nor the tree has to fit in
+         *          memory. Only UTF-8 input is accepted.
+         *  @param  path    path of the input file
+         *  @param  tree    tree created with DOMmappedTree::create, finished
+         *                  by this call
+         *  @return -2  error
+         *          0   if parsed successfully
+         * */
+        int parse_mapped(const std::filesystem::path &path, DOMmappedTree &tree)
+        {
+            spec = nullptr;
+            error_at = 0;
+            mapped_input file;
+            if (!file.open(path))
+                return -2;
+
+            const char *begin = file.data();
+            const char *end = begin + file.size();
+            std::size_t bom_length;
+            if (detect_encoding(begin, file.size(), bom_length) != text_encoding::utf8)
+                return -2;
+            begin += bom_length;
+            if (validate_utf8)
+            {
+                utf8_validator validator;
+                if (!validator.validate(begin, end - begin) || !validator.finish())
+                {
+                    error_at = validator.error_offset();
+                    return -2;
+                }
+            }
+
+            int res = run(tree, begin, end);
+            if (!tree.finish())
+                return -2;
+            return res;
+        }
+#endif
+
+        /**
+         *  @brief  Parses the input into the tree, recording the byte offsets
+         *          of every node in the UTF-8 input, see release_input().
+         *  @param  source  source of the input
+         *  @param  tree    tree to be replaced by the parsed document
+         *  @param  _spans  replaced by the spans, indexed by node UID
+         *  @return -2  error, tree is left untouched
+         *          0   if parsed successfully
+         * */
+        int parse(std::unique_ptr<input_source> &&source, DOMtree &tree, std::vector<node_span> &_spans)
+        {
+            _spans.clear();
+            spans = &_spans;
+            int res = parse(std::move(source), tree, nullptr);
+            spans = nullptr;
+            return res;
+        }
+
+        /**
+         *  @brief  Parses a fragment of markup straight into an existing tree.
+         *          The fragment may hold any number of elements and text at
+         *          its top level, which are added under the parent in order.
+         *  @param  text    UTF-8 markup of the fragment
+         *  @param  tree    tree receiving the nodes
+         *  @param  parent  existing element the fragment is added under
+         *  @param  after   child of the parent to follow, -1 for the first
+         *                  place, -2 for the last place
+         *  @return -2  error, tree is left untouched
+         *          -1  if the parent does not exist or stores inner data
+         *          0   if parsed successfully
+         * */
+        int parse_fragment(std::string_view text, DOMtree &tree, DOMnodeUID parent, DOMnodeUID after = -2)
+        {
+            spec = nullptr;
+            error_at = 0;
+            DOMfragmentBuilder into(tree, parent, after);
+            if (!into.valid())
+                return -1;
+            if (validate_utf8)
+            {
+                utf8_validator validator;
+                if (!validator.validate(text.data(), text.size()) || !validator.finish())
+                {
+                    error_at = validator.error_offset();
+                    return -2;
+                }
+            }
+
+            fragment = true;
+            int res = run(into, text.data(), text.data() + text.size());
+            fragment = false;
+            if (res == 0)
+                into.finish();
+            else
+                into.rollback();
+            return res;
+        }
+
+        /**
+         *  @brief  Parses a fragment read from the source straight into an
+         *          existing tree, see the overload taking the markup.
+         * */
+        int parse_fragment(std::unique_ptr<input_source> &&source, DOMtree &tree, DOMnodeUID parent,
+                           DOMnodeUID after = -2)
+        {
+            if (!source->is_open())
+                return -2;
+            if (!load(std::move(source)))
+            {
+                error_at = data.size();
+                return -2;
+            }
+            bool validate = validate_utf8;
+            validate_utf8 = false; // done by load
+            int res = parse_fragment(std::string_view(data), tree, parent, after);
+            validate_utf8 = validate;
+            return res;
+        }
+
+        /**
+         *  @brief  Moves out the UTF-8 input of the last parse, the text the
+         *          recorded spans refer to.
+         * */
+        inline std::string release_input()
+        {
+            return std::move(data);
+        }
+
+        /**
+         *  @brief  Hands storage of a tree no longer needed to the builder,
+         *          the next parse builds into it.
+         * */
+        inline void reuse(DOMtree &&storage)
+        {
+            builder.reuse(std::move(storage));
+        }
+
+        /**
+         *  @brief  Returns the byte offset in the UTF-8 input where the last
+         *          parse failed.
+         * */
+        inline std::size_t error_offset()
+        {
+            return error_at;
+        }
+    };
+} // namespace dom_parser
+
+#endif
@@ -15,12 +15,21 @@
 #ifndef DOM_PARSER_DOM_LEXER
 #define DOM_PARSER_DOM_LEXER
 
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <queue>
 #include <memory>
+#include <vector>
 #include <filesystem>
 #include <fstream>
 
+#include "DOMencoding.hpp"
+#include "DOMentities.hpp"
+#include "DOMinput.hpp"
+#include "DOMmarkup.hpp"
+
 #ifdef DOM_PARSER_DEBUG_MODE
 #include <iostream>
 #endif
@@ -54,6 +63,8 @@ namespace dom_parser
         const static char T_DBLQUOT = '\"';
         // a single quote `'`
         const static char T_SINQUOT = '\'';
+        // a CDATA section, its text taken as it is
+        const static char T_CDATSEC = 'C';
     };
 
     /**
@@ -64,6 +75,9 @@ namespace dom_parser
     public:
         char token;
         std::string value;
+        std::size_t offset = 0; // byte offset in the UTF-8 input, after the byte order mark
+        std::size_t line = 1;   // line number, counted from 1
+        bool space_before = false; // white space separates it from the token before
 
         /**
          *  @brief Constructor
@@ -84,9 +98,162 @@ namespace dom_parser
     {
     private:
         std::queue<std::shared_ptr<lexer_token>> token_buffer;
-        std::ifstream fin;
+        std::vector<std::shared_ptr<lexer_token>> spare_tokens; // consumed tokens, for reuse
         bool scan_inner_data = false;
 
+        // input, read in chunks and validated as UTF-8 chunk by chunk
+        std::unique_ptr<input_source> source;
+        std::vector<char> chunk;
+        std::size_t chunk_pos = 0;
+        std::size_t chunk_end = 0;
+        bool input_done = false;
+        text_encoding encoding = text_encoding::utf8;
+        bool validate_utf8;
+        utf8_validator validator;
+        bool encoding_failed = false;
+        bool markup_failed = false; // a comment, PI, CDATA or declaration is not closed
+
+        // position of the input for the tokens
+        std::size_t input_offset = 0; // offset of the start of chunk
+        std::size_t line = 1;         // line at chunk_pos
+        std::size_t word_offset = 0;  // offset of the last word read
+        std::size_t token_offset = 0; // offset of the next token added
+        std::size_t token_line = 1;   // line of the next token added
+        bool space_pending = false;   // white space read since the last token added
+
+        const static std::size_t chunk_size = 1 << 16;
+
+        /**
+         *  @brief  Opens the input: reads the first chunk, detects the encoding
+         *          and puts a transcoder in front of the source if the input
+         *          is not UTF-8.
+         * */
+        void open_input()
+        {
+            chunk.resize(chunk_size);
+            chunk_end = source->read(chunk.data(), chunk.size());
+
+            std::size_t bom_length;
+            encoding = detect_encoding(chunk.data(), chunk_end, bom_length);
+            if (encoding != text_encoding::utf8)
+            {
+                source.reset(new transcoding_source(
+                    std::move(source), encoding,
+                    std::string(chunk.data() + bom_length, chunk_end - bom_length)));
+                chunk_end = 0;
+                return;
+            }
+
+            chunk_end -= bom_length; // offsets are counted after the byte order mark
+            std::memmove(chunk.data(), chunk.data() + bom_length, chunk_end);
+            if (chunk_end == 0)
+                input_done = true;
+            else if (validate_utf8 && !validator.validate(chunk.data() + chunk_pos, chunk_end - chunk_pos))
+                fail_input();
+        }
+
+        /**
+         *  @brief  Stops the input because of an encoding error. The bytes of
+         *          the chunk before the error are still scanned, up to the last
+         *          complete character.
+         * */
+        void fail_input()
+        {
+            encoding_failed = true;
+            input_done = true;
+
+            std::size_t error_at = validator.error_offset();
+            std::size_t end = (error_at > input_offset) ? std::min(error_at - input_offset, chunk_end) : 0;
+            end = std::max(end, chunk_pos);
+            std::size_t lead = end;
+            while (lead > chunk_pos && (static_cast<unsigned char>(chunk[lead - 1]) & 0xC0) == 0x80)
+                --lead;
+            if (lead == chunk_pos)
+                end = lead;
+            else
+            {
+                unsigned char c = chunk[lead - 1];
+                std::size_t length = (c < 0xC0) ? 1 : (c < 0xE0) ? 2 : (c < 0xF0) ? 3 : 4;
+                if (lead - 1 + length > end)
+                    end = lead - 1;
+            }
+            chunk_end = end;
+        }
+
+        /**
+         *  @brief  Reads the next chunk of input and validates it.
+         *  @return false if there is no more input
+         * */
+        bool refill()
+        {
+            if (input_done)
+                return false;
+
+            input_offset += chunk_end;
+            chunk_pos = 0;
+            chunk_end = source->read(chunk.data(), chunk.size());
+            if (chunk_end == 0)
+            {
+                input_done = true;
+                if (source->failed() || (validate_utf8 && !validator.finish()))
+                    encoding_failed = true;
+                return false;
+            }
+            if (validate_utf8 && !validator.validate(chunk.data(), chunk_end))
+            {
+                fail_input();
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         *  @brief  Checks for the white space chars which separate words.
+         * */
+        static inline bool is_space(char c)
+        {
+            return (c == ' ' || c == '\n' || c == '\t' ||
+                    c == '\r' || c == '\v' || c == '\f');
+        }
+
+        /**
+         *  @brief  Reads the next white space separated word of the input.
+         *  @param  buff    string the word is stored in
+         *  @return false if the input is finished
+         * */
+        bool next_word(std::string &buff)
+        {
+            buff.clear();
+
+            // skip white space
+            while (true)
+            {
+                while (chunk_pos < chunk_end && is_space(chunk[chunk_pos]))
+                {
+                    line += (chunk[chunk_pos++] == '\n');
+                    space_pending = true;
+                }
+                if (chunk_pos < chunk_end)
+                    break;
+                if (!refill())
+                    return false;
+            }
+
+            // collect the word, which may continue in the next chunk
+            word_offset = input_offset + chunk_pos;
+            while (true)
+            {
+                std::size_t start = chunk_pos;
+                while (chunk_pos < chunk_end && !is_space(chunk[chunk_pos]))
+                    ++chunk_pos;
+                buff.append(chunk.data() + start, chunk_pos - start);
+                if (chunk_pos < chunk_end)
+                    return true;
+                if (!refill())
+                    return true; // the input ended, or stopped at an encoding error, after the word
+            }
+        }
+
         /**
          *  @brief  Adds token to token_buffer
          *  @param  _token  token taken from lexer_token_values
@@ -94,11 +261,32 @@ namespace dom_parser
          * */
         void buffer_add_token(char _token, std::string &&_value)
         {
-            token_buffer.push(
-                std::move(
-                    std::shared_ptr<lexer_token>(
-                        new lexer_token(
-                            _token, std::move(_value)))));
+            std::shared_ptr<lexer_token> spare;
+            if (spare_tokens.empty())
+                spare.reset(new lexer_token(_token, std::move(_value)));
+            else
+            {
+                spare = std::move(spare_tokens.back());
+                spare_tokens.pop_back();
+                spare->token = _token;
+                spare->value.swap(_value);
+            }
+            spare->offset = token_offset;
+            spare->line = token_line;
+            spare->space_before = space_pending;
+            space_pending = false;
+            token_buffer.push(std::move(spare));
+        }
+
+        /**
+         *  @brief  Removes the front token from token_buffer, keeping it
+         *          for reuse if nothing else refers to it.
+         * */
+        inline void buffer_pop_token()
+        {
+            if (token_buffer.front().use_count() == 1)
+                spare_tokens.push_back(std::move(token_buffer.front()));
+            token_buffer.pop();
         }
 
         /**
@@ -112,91 +300,227 @@ namespace dom_parser
         }
 
         /**
-         *  @brief  Generates tokens for the next input from file
+         *  @brief  Reads on from the input until the marker is found.
+         *  @param  text    bytes read so far, the input read is appended
+         *  @param  from    position in text the marker may start at
+         *  @param  marker  end of the construct, such as "-->"
+         *  @param  found   set to the position of the marker in text
+         *  @return false if the input ends first
+         * */
+        bool read_through(std::string &text, std::size_t from, std::string_view marker, std::size_t &found)
+        {
+            found = text.find(marker.data(), from, marker.size());
+            if (found != std::string::npos)
+                return true;
+
+            const std::size_t n = marker.size();
+            while (true)
+            {
+                if (chunk_pos == chunk_end && !refill())
+                    return false;
+
+                // the marker split between the text and the chunk
+                std::size_t keep = std::min(n - 1, text.size() - std::min(from, text.size()));
+                if (keep != 0)
+                {
+                    std::string seam = text.substr(text.size() - keep);
+                    seam.append(chunk.data() + chunk_pos, std::min(n - 1, chunk_end - chunk_pos));
+                    std::size_t at = seam.find(marker.data(), 0, n);
+                    if (at != std::string::npos)
+                    {
+                        std::size_t used = at + n - keep;
+                        text.append(chunk.data() + chunk_pos, used);
+                        line += std::count(chunk.data() + chunk_pos, chunk.data() + chunk_pos + used, '\n');
+                        chunk_pos += used;
+                        found = text.size() - n;
+                        return true;
+                    }
+                }
+
+                const char *begin = chunk.data() + chunk_pos;
+                const char *at = find_marker(begin, chunk.data() + chunk_end, marker);
+                std::size_t used = (at == nullptr) ? chunk_end - chunk_pos : at + n - begin;
+                text.append(begin, used);
+                line += std::count(begin, begin + used, '\n');
+                chunk_pos += used;
+                if (at != nullptr)
+                {
+                    found = text.size() - n;
+                    return true;
+                }
+            }
+        }
+
+        /**
+         *  @brief  Takes a comment, processing instruction, declaration or
+         *          CDATA section, reading on from the input where it goes past
+         *          the word. Only CDATA sections leave a token.
+         *  @param  text    the word from the "<!" or "<?" starting the construct,
+         *                  replaced by the rest of the word after it
+         *  @return false if the input ends first
+         * */
+        bool take_markup(std::string &text)
+        {
+            std::string_view marker = ">";
+            std::size_t open = 2;
+            if (text[1] == '?')
+                marker = "?>";
+            else if (text.compare(0, 4, "<!--") == 0)
+                marker = "-->", open = 4;
+            else if (text.compare(0, 9, "<![CDATA[") == 0)
+                marker = "]]>", open = 9;
+            bool declaration = (marker == ">");
+
+            std::size_t found;
+            if (!read_through(text, open, marker, found))
+                return false;
+            // a declaration ends at the first '>' outside of quotes and brackets
+            while (declaration && declaration_end(text.data() + 2, text.data() + found + 1) == nullptr)
+                if (!read_through(text, found + 1, marker, found))
+                    return false;
+
+            if (open == 9)
+                buffer_add_token(lexer_token_values::T_CDATSEC, text.substr(open, found - open));
+            text.erase(0, found + marker.size());
+            return true;
+        }
+
+        /**
+         *  @brief  Generates tokens for the next input from file. Comments,
+         *          processing instructions and declarations leave no tokens,
+         *          so words are read till some token is generated.
          * */
         void generate_tokens()
         {
             std::string buff;
-            if (fin >> buff) // if input successful
+            while (token_buffer.empty())
             {
-                for (auto i = buff.begin(); i != buff.end(); ++i)
+                if (!next_word(buff))
+                {
+                    token_offset = input_offset + chunk_pos;
+                    token_line = line;
+                    buffer_add_token(lexer_token_values::T_FILEEND, std::move(""));
+                    return;
+                }
+
+                std::size_t at, base = word_offset; // offset of buff
+                token_line = line;                  // words hold no line breaks
+                while ((at = find_markup(buff)) != std::string::npos)
                 {
-                    std::string token_value;
-                    char token_name;
-                    switch (*i)
+                    std::string rest = buff.substr(at);
+                    buff.resize(at);
+                    tokenize_word(buff, base);
+                    token_offset = base + at;
+                    std::size_t length = rest.size();
+                    if (!take_markup(rest))
                     {
-                    case '<':
-                        token_name = lexer_token_values::T_OPENTAG;
-                        token_value = token_name;
+                        markup_failed = true;
+                        token_offset = input_offset + chunk_pos;
+                        token_line = line;
+                        buffer_add_token(lexer_token_values::T_FILEEND, std::move(""));
+                        return;
+                    }
+                    base += at + (length - rest.size()); // only used if the construct ended in the word
+                    buff.swap(rest);
+                }
+                tokenize_word(buff, base);
+            }
+        }
+
+        /**
+         *  @brief  Finds the "<!" or "<?" starting a comment, processing
+         *          instruction, declaration or CDATA section in a word.
+         * */
+        static inline std::size_t find_markup(const std::string &word)
+        {
+            for (std::size_t at = word.find('<'); at != std::string::npos; at = word.find('<', at + 1))
+                if (at + 1 < word.size() && (word[at + 1] == '!' || word[at + 1] == '?'))
+                    return at;
+            return std::string::npos;
+        }
+
+        /**
+         *  @brief  Generates the tokens of a word without markup constructs.
+         *  @param  buff    the word
+         *  @param  base    offset of the word in the input
+         * */
+        void tokenize_word(std::string &buff, std::size_t base)
+        {
+            for (auto i = buff.begin(); i != buff.end(); ++i)
+            {
+                token_offset = base + (i - buff.begin());
+                std::string token_value;
+                char token_name;
+                switch ((scan_inner_data && *i != '<') ? '\0' : *i) // only '<' ends inner data
+                {
+                case '<':
+                    token_name = lexer_token_values::T_OPENTAG;
+                    token_value = token_name;
 
 #ifdef DOM_PARSER_DEBUG_MODE
-                        std::cout << "\n\tdebug: LEXER: "
-                                  << "set_scan_inner_data: TRUE\n";
+                    std::cout << "\n\tdebug: LEXER: "
+                              << "set_scan_inner_data: TRUE\n";
 #endif
-                        scan_inner_data = false; // not scanning inner data
-                                                 // of node
+                    scan_inner_data = false; // not scanning inner data
+                                             // of node
 
-                        break;
-                    case '>':
-                        token_name = lexer_token_values::T_CLOSTAG;
-                        token_value = token_name;
+                    break;
+                case '>':
+                    token_name = lexer_token_values::T_CLOSTAG;
+                    token_value = token_name;
 
 #ifdef DOM_PARSER_DEBUG_MODE
-                        std::cout << "\n\tdebug: LEXER: "
-                                  << "set_scan_inner_data: TRUE\n";
+                    std::cout << "\n\tdebug: LEXER: "
+                              << "set_scan_inner_data: TRUE\n";
 #endif
-                        scan_inner_data = true; // might be scanning inner
-                                                // data of node
-
-                        break;
-                    case '/':
-                        token_name = lexer_token_values::T_BKSLASH;
-                        token_value = token_name;
-                        break;
-                    case '=':
-                        token_name = lexer_token_values::T_EQLSIGN;
-                        token_value = token_name;
-                        break;
-                    case '\"':
-                        token_name = lexer_token_values::T_DBLQUOT;
-                        token_value = token_name;
-                        break;
-                    case '\'':
-                        token_name = lexer_token_values::T_SINQUOT;
-                        token_value = token_name;
-                        break;
-                    default:
-                        token_name = lexer_token_values::T_IDNTIFR;
-                        token_value = "";
-                        while (i != buff.end())
+                    scan_inner_data = true; // might be scanning inner
+                                            // data of node
+
+                    break;
+                case '/':
+                    token_name = lexer_token_values::T_BKSLASH;
+                    token_value = token_name;
+                    break;
+                case '=':
+                    token_name = lexer_token_values::T_EQLSIGN;
+                    token_value = token_name;
+                    break;
+                case '\"':
+                    token_name = lexer_token_values::T_DBLQUOT;
+                    token_value = token_name;
+                    break;
+                case '\'':
+                    token_name = lexer_token_values::T_SINQUOT;
+                    token_value = token_name;
+                    break;
+                default:
+                    token_name = lexer_token_values::T_IDNTIFR;
+                    token_value = "";
+                    while (i != buff.end())
+                    {
+                        token_value += *i;
+                        ++i;
+                        if ((!scan_inner_data && check_special_char(*i)) ||
+                            (scan_inner_data && *i == '<'))
                         {
-                            token_value += *i;
-                            ++i;
-                            if ((!scan_inner_data && check_special_char(*i)) ||
-                                (scan_inner_data && *i == '<'))
-                            {
 
 #ifdef DOM_PARSER_DEBUG_MODE
-                                std::cout << "\n\tdebug: LEXER: "
-                                          << "set_scan_inner_data: FALSE\n";
+                            std::cout << "\n\tdebug: LEXER: "
+                                      << "set_scan_inner_data: FALSE\n";
 #endif
-                                scan_inner_data = false;
-                                --i; // --i because for-loop would ++i anyway
-                                break;
-                            }
+                            scan_inner_data = false;
+                            --i; // --i because for-loop would ++i anyway
+                            break;
                         }
-                        break;
                     }
+                    decode_entities(token_value); // no-op without '&'
+                    break;
+                }
 
-                    buffer_add_token(token_name, std::move(token_value));
+                buffer_add_token(token_name, std::move(token_value));
 
-                    if (i == buff.end()) // if buffer end has already reached then terminate the
-                        break;           // loop otherwise i would be incremented further end()
-                }
-            }
-            else // file finished
-            {
-                buffer_add_token(lexer_token_values::T_FILEEND, std::move(""));
+                if (i == buff.end()) // if buffer end has already reached then terminate the
+                    break;           // loop otherwise i would be incremented further end()
             }
         }
 
@@ -206,20 +530,100 @@ namespace dom_parser
 
         /**
          *  @brief  Constructor
-         *  @param  path    path of the file which is to be scanned.
+         *  @param  path            path of the file which is to be scanned.
+         *  @param  _validate_utf8  reject input which is not valid UTF-8
+         * */
+        lexer(std::filesystem::path path, bool _validate_utf8 = true)
+            : source(open_file_source(path)), validate_utf8(_validate_utf8)
+        {
+            open_input();
+            buffer_add_token(lexer_token_values::T_FILEBEG, std::move(""));
+        }
+
+        /**
+         *  @brief  Constructor
+         *  @param  _source         source of the input which is to be scanned.
+         *  @param  _validate_utf8  reject input which is not valid UTF-8
+         * */
+        lexer(std::unique_ptr<input_source> &&_source, bool _validate_utf8 = true)
+            : source(std::move(_source)), validate_utf8(_validate_utf8)
+        {
+            open_input();
+            buffer_add_token(lexer_token_values::T_FILEBEG, std::move(""));
+        }
+
+        /**
+         *  @brief  Starts scanning another input, keeping the buffers and the
+         *          tokens allocated for the previous one.
+         *  @param  _source     source of the input which is to be scanned.
          * */
-        lexer(std::filesystem::path path)
+        void reset(std::unique_ptr<input_source> &&_source)
         {
-            fin.open(path);
+            while (!token_buffer.empty())
+                buffer_pop_token();
+            scan_inner_data = false;
+            source = std::move(_source);
+            chunk_pos = chunk_end = 0;
+            input_done = false;
+            encoding_failed = false;
+            markup_failed = false;
+            input_offset = word_offset = token_offset = 0;
+            line = token_line = 1;
+            space_pending = false;
+            validator = utf8_validator();
+            open_input();
             buffer_add_token(lexer_token_values::T_FILEBEG, std::move(""));
         }
 
+        /**
+         *  @brief  Checks if the input was found to be invalid UTF-8, or could
+         *          not be transcoded to UTF-8. The input ends at the error.
+         * */
+        inline bool encoding_error()
+        {
+            return encoding_failed;
+        }
+
+        /**
+         *  @brief  Checks if the input ended inside a comment, processing
+         *          instruction, declaration or CDATA section.
+         * */
+        inline bool markup_error()
+        {
+            return markup_failed;
+        }
+
+        /**
+         *  @brief  Returns the offset of the first invalid byte in the UTF-8
+         *          input, as seen after transcoding.
+         * */
+        inline std::size_t encoding_error_offset()
+        {
+            return validator.error_offset();
+        }
+
+        /**
+         *  @brief  Returns the encoding detected for the input.
+         * */
+        inline text_encoding get_encoding()
+        {
+            return encoding;
+        }
+
+        /**
+         *  @brief  Returns the pointer to the token last returned by next().
+         * */
+        inline lexer_token *current()
+        {
+            return token_buffer.front().get();
+        }
+
         /**
          *  @brief  Returns the pointer to the next token from the token buffer.
          * */
         lexer_token *next()
         {
-            token_buffer.pop();
+            buffer_pop_token();
             if (token_buffer.size() == 0)
                 generate_tokens();
 
@@ -0,0 +1,289 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_BATCH
+#define DOM_PARSER_DOM_BATCH
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "DOMparser.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Parses many documents on a pool of threads. Every worker owns a
+     *          range of the documents and takes them from its front; a worker
+     *          which runs out steals the back half of another worker's range,
+     *          so a few large documents do not leave the other threads idle.
+     *          Every worker keeps its parser between documents and calls, so
+     *          the tree storage is reused.
+     *
+     *          Results are handed to a callback as the documents finish. Without
+     *          ordered delivery the callback runs on the workers, possibly on
+     *          several at once. With ordered delivery it is called for one
+     *          document at a time in the order of the input; documents which
+     *          finish early are held until their turn.
+     * */
+    class batch_loader
+    {
+    public:
+        /**
+         *  @brief  Receives a parsed document.
+         *  @param  index   position of the document in the input
+         *  @param  result  return value of DOMparser::loadTree_fast
+         *  @param  tree    the parsed tree; move it out to keep it, otherwise
+         *                  its storage is reused for the next document
+         * */
+        typedef std::function<void(std::size_t index, int result, DOMtree &tree)> tree_callback;
+
+        /**
+         *  @brief  Receives the result of scanning a document with queries.
+         *  @param  index   position of the document in the input
+         *  @param  result  return value of DOMparser::runQueries
+         * */
+        typedef std::function<void(std::size_t index, int result)> scan_callback;
+
+        /**
+         *  @brief  Registers the queries on the matcher of a worker.
+         *  @param  matcher matcher of the worker
+         *  @param  current index of the document the worker is scanning while
+         *                  the query callbacks are called
+         * */
+        typedef std::function<void(stream_matcher &matcher, const std::size_t &current)> matcher_setup;
+
+    private:
+        struct work_range
+        {
+            std::mutex lock;
+            std::size_t begin = 0;
+            std::size_t end = 0;
+        };
+
+        struct worker
+        {
+            DOMparser parser;
+            stream_matcher matcher;
+            std::size_t current = 0;
+        };
+
+        std::size_t threads;
+        bool ordered;
+        std::vector<std::unique_ptr<worker>> workers;
+
+        // ordered delivery: finished documents waiting for their turn
+        std::mutex order_lock;
+        std::map<std::size_t, std::pair<int, DOMtree>> finished;
+        std::size_t next_delivery = 0;
+        bool delivering = false;
+        std::vector<DOMtree> spare_trees; // delivered trees, their storage is reused by the workers
+
+        /**
+         *  @brief  Takes the next document of the worker, stealing from the
+         *          other workers once its own range is empty.
+         *  @return false once no work is left anywhere
+         * */
+        static bool take(std::vector<work_range> &ranges, std::size_t self, std::size_t &index)
+        {
+            {
+                std::lock_guard<std::mutex> guard(ranges[self].lock);
+                if (ranges[self].begin < ranges[self].end)
+                {
+                    index = ranges[self].begin++;
+                    return true;
+                }
+            }
+
+            for (std::size_t i = 1; i < ranges.size(); i++)
+            {
+                work_range &victim = ranges[(self + i) % ranges.size()];
+                std::size_t begin, end;
+                {
+                    std::lock_guard<std::mutex> guard(victim.lock);
+                    if (victim.begin >= victim.end)
+                        continue;
+                    begin = victim.begin + (victim.end - victim.begin) / 2;
+                    end = victim.end;
+                    victim.end = begin;
+                }
+                index = begin;
+                std::lock_guard<std::mutex> guard(ranges[self].lock);
+                ranges[self].begin = begin + 1;
+                ranges[self].end = end;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         *  @brief  Hands a finished document to the callback, in input order
+         *          if delivery is ordered. An ordered document may have to wait,
+         *          so the tree is then replaced by a delivered one, whose
+         *          storage the worker reuses.
+         * */
+        void deliver(const tree_callback &done, std::size_t index, int result, DOMtree &tree)
+        {
+            if (!ordered)
+            {
+                done(index, result, tree);
+                return;
+            }
+
+            std::unique_lock<std::mutex> guard(order_lock);
+            finished.emplace(index, std::make_pair(result, std::move(tree)));
+            if (!spare_trees.empty())
+            {
+                tree = std::move(spare_trees.back());
+                spare_trees.pop_back();
+            }
+            if (delivering)
+                return; // the delivering worker picks it up
+            delivering = true;
+            while (!finished.empty() && finished.begin()->first == next_delivery)
+            {
+                auto ready = finished.extract(finished.begin());
+                guard.unlock();
+                done(ready.key(), ready.mapped().first, ready.mapped().second);
+                guard.lock();
+                ++next_delivery;
+                if (spare_trees.size() < workers.size())
+                    spare_trees.push_back(std::move(ready.mapped().second));
+            }
+            delivering = false;
+        }
+
+        /**
+         *  @brief  Runs job(worker, index) for every index below count on the
+         *          pool, the calling thread being one of the workers.
+         * */
+        template <typename Job>
+        void run(std::size_t count, Job job)
+        {
+            std::size_t n = std::max<std::size_t>(1, std::min(threads, count));
+            while (workers.size() < n)
+                workers.emplace_back(new worker());
+            finished.clear();
+            next_delivery = 0;
+            delivering = false;
+
+            std::vector<work_range> ranges(n);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                ranges[i].begin = count * i / n;
+                ranges[i].end = count * (i + 1) / n;
+            }
+
+            auto work = [&](std::size_t self) {
+                std::size_t index;
+                while (take(ranges, self, index))
+                    job(*workers[self], index);
+            };
+            std::vector<std::thread> pool;
+            for (std::size_t i = 1; i < n; i++)
+                pool.emplace_back(work, i);
+            work(0);
+            for (auto &t : pool)
+                t.join();
+        }
+
+        /**
+         *  @brief  Loads a document on a worker and delivers it.
+         * */
+        void load_one(worker &w, std::size_t index, std::unique_ptr<input_source> &&source,
+                      const tree_callback &done)
+        {
+            int result = w.parser.loadTree_fast(std::move(source));
+            DOMtree tree = w.parser.releaseTree();
+            deliver(done, index, result, tree);
+            w.parser.setTree(std::move(tree));
+            w.parser.reset(); // the next document is built into this storage
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _threads    number of threads, 0 for the hardware concurrency
+         *  @param  _ordered    deliver the documents in the order of the input
+         * */
+        batch_loader(unsigned _threads = 0, bool _ordered = false)
+            : threads(_threads), ordered(_ordered)
+        {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        /**
+         *  @brief  Loads the files with fast_parser.
+         *  @param  paths   files to be loaded
+         *  @param  done    receives every parsed document
+         * */
+        void load(const std::vector<std::filesystem::path> &paths, const tree_callback &done)
+        {
+            run(paths.size(), [&](worker &w, std::size_t index) {
+                load_one(w, index, std::unique_ptr<input_source>(new file_source(paths[index])), done);
+            });
+        }
+
+        /**
+         *  @brief  Loads the documents held in memory with fast_parser.
+         *  @param  buffers documents to be loaded, not copied
+         *  @param  done    receives every parsed document
+         * */
+        void load(const std::vector<std::string_view> &buffers, const tree_callback &done)
+        {
+            run(buffers.size(), [&](worker &w, std::size_t index) {
+                load_one(w, index, std::unique_ptr<input_source>(new view_source(buffers[index])), done);
+            });
+        }
+
+        /**
+         *  @brief  Evaluates queries over the files in streaming passes, no
+         *          trees are built. Every worker has its own matcher set up by
+         *          setup, whose query callbacks run on that worker.
+         *  @param  paths   files to be scanned
+         *  @param  setup   registers the queries on a worker's matcher, called
+         *                  once per worker and call
+         *  @param  done    receives the result of every file
+         * */
+        void scan(const std::vector<std::filesystem::path> &paths, const matcher_setup &setup,
+                  const scan_callback &done)
+        {
+            std::size_t n = std::max<std::size_t>(1, std::min(threads, paths.size()));
+            while (workers.size() < n)
+                workers.emplace_back(new worker());
+            for (std::size_t i = 0; i < n; i++)
+            {
+                workers[i]->matcher = stream_matcher();
+                setup(workers[i]->matcher, workers[i]->current);
+            }
+
+            run(paths.size(), [&](worker &w, std::size_t index) {
+                w.current = index;
+                int result = w.parser.runQueries(paths[index], w.matcher);
+                DOMtree none;
+                deliver([&](std::size_t i, int r, DOMtree &) { done(i, r); }, index, result, none);
+            });
+        }
+    };
+} // namespace dom_parser
+
+#endif
@@ -0,0 +1,536 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_DIFF
+#define DOM_PARSER_DOM_DIFF
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "DOMtree.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Single edit of an edit script. Nodes of the edited tree are
+     *          referred to by their UIDs, nodes inserted by the script by
+     *          DOMedit::inserted(i), i counting the inserts from 0.
+     * */
+    struct DOMedit
+    {
+        enum class kind
+        {
+            insert_element,  // node <- new element name with attributes under parent, after after
+            insert_text,     // node <- new inner-data node value under parent, after after
+            move,            // node moved under parent, after after
+            remove,          // node removed with its subtree
+            rename,          // tag name of node set to name
+            set_text,        // inner data of node set to value
+            set_attribute,   // attribute name of node set to value
+            remove_attribute // attribute name of node removed
+        };
+
+        kind type = kind::remove;
+        DOMnodeUID node = -1;
+        DOMnodeUID parent = -1;
+        DOMnodeUID after = -1; // sibling to follow, -1 for the first place
+        std::string name;
+        std::string value;
+        DOMattributes attributes;
+
+        DOMedit() {}
+
+        /**
+         *  @brief  Constructor, name, value and attributes are left empty.
+         * */
+        DOMedit(kind _type, DOMnodeUID _node, DOMnodeUID _parent = -1, DOMnodeUID _after = -1)
+            : type(_type), node(_node), parent(_parent), after(_after) {}
+
+        /**
+         *  @brief  Reference to the i-th node inserted by the script.
+         * */
+        static constexpr DOMnodeUID inserted(std::size_t i)
+        {
+            return -2 - DOMnodeUID(i);
+        }
+    };
+
+    typedef std::vector<DOMedit> DOMeditScript;
+
+    /**
+     *  @brief  Computes edit scripts between trees and applies them. Subtrees
+     *          are matched top-down: first siblings with equal subtree hashes,
+     *          then siblings with equal tag names, then the remaining sibling
+     *          elements in order as renames. Nodes left over are matched with
+     *          any unmatched subtree of the old tree with an equal hash, which
+     *          becomes a move.
+     *          Identical subtrees are matched as a whole without comparing
+     *          their nodes, so the work is near linear in the tree size. Children kept in
+     *          place are chosen by a longest increasing subsequence, so only
+     *          the children out of order are moved.
+     * */
+    class tree_differ
+    {
+    private:
+        DOMtree &from;
+        DOMtree &to;
+        DOMeditScript script;
+        std::size_t inserted_count = 0;
+
+        // node of from matched to each node of to, an inserted reference
+        // for new nodes once their insert is emitted, -1 while unmatched
+        std::vector<DOMnodeUID> match;
+        const static DOMnodeUID fresh = -2; // new node, insert not emitted yet
+        std::vector<char> exact; // node of to matched with its whole subtree
+        // 0 unmatched, 1 matched, 2 unmatched with matched descendants
+        std::vector<char> used;
+        // elements of from by subtree hash, for finding moved subtrees
+        std::unordered_map<std::uint64_t, std::vector<DOMnodeUID>> from_by_hash;
+
+        // scratch of the sibling matching
+        std::vector<std::pair<std::uint64_t, std::size_t>> by_hash;
+        std::vector<std::pair<std::pair<int, std::string_view>, std::size_t>> by_name;
+        std::vector<DOMnodeUID> from_children, to_children;
+        std::vector<DOMnodeUID> position;
+        std::vector<DOMnodeUID> subtree_stack;
+
+        void markUsed(DOMnodeUID node)
+        {
+            used[node] = 1;
+            for (DOMnodeUID p = from._nodes(node).getParent(); p != -1 && used[p] == 0; p = from._nodes(p).getParent())
+                used[p] = 2;
+        }
+
+        void matchExact(DOMnodeUID to_node, DOMnodeUID from_node)
+        {
+            match[to_node] = from_node;
+            exact[to_node] = 1;
+            markUsed(from_node);
+            subtree_stack.assign(from._nodes(from_node).getChildrenUID().begin(),
+                                 from._nodes(from_node).getChildrenUID().end());
+            while (!subtree_stack.empty())
+            {
+                DOMnodeUID node = subtree_stack.back();
+                subtree_stack.pop_back();
+                used[node] = 1;
+                for (DOMnodeUID child : from._nodes(node).getChildrenUID())
+                    subtree_stack.push_back(child);
+            }
+        }
+
+        inline void matchUpdate(DOMnodeUID to_node, DOMnodeUID from_node)
+        {
+            match[to_node] = from_node;
+            markUsed(from_node);
+        }
+
+        /**
+         *  @brief  Pairs children of to_node with free children of from_node
+         *          having an equal key. Each to child takes the first candidate
+         *          after the from child matched to its previous sibling, so
+         *          runs of siblings stay aligned, or else the first candidate.
+         * */
+        template <typename Key, typename KeyOf, typename Pair>
+        void pairChildren(DOMnodeUID from_node, std::vector<std::pair<Key, std::size_t>> &keys,
+                          KeyOf key_of, Pair pair)
+        {
+            keys.clear();
+            for (std::size_t i = 0; i < from_children.size(); ++i)
+                if (used[from_children[i]] == 0)
+                    keys.emplace_back(key_of(from, from_children[i]), i);
+            if (keys.empty())
+                return;
+            std::sort(keys.begin(), keys.end());
+
+            auto free_in = [&](auto i, auto end) {
+                while (i != end && used[from_children[i->second]] != 0)
+                    ++i;
+                return i;
+            };
+            std::size_t next = 0; // position after the from child of the previous sibling
+            for (DOMnodeUID to_child : to_children)
+            {
+                DOMnodeUID m = match[to_child];
+                if (m != -1)
+                {
+                    if (m >= 0 && from._nodes(m).getParent() == from_node)
+                        next = position[m] + 1;
+                    continue;
+                }
+                Key key = key_of(to, to_child);
+                auto group = std::lower_bound(keys.begin(), keys.end(), std::make_pair(key, std::size_t(0)));
+                auto group_end = std::upper_bound(group, keys.end(), std::make_pair(key, from_children.size()));
+                auto after = std::lower_bound(group, group_end, std::make_pair(key, next));
+                auto found = free_in(after, group_end);
+                if (found == group_end && (found = free_in(group, after)) == after)
+                    continue;
+                pair(to_child, from_children[found->second]);
+                next = found->second + 1;
+            }
+        }
+
+        static inline std::pair<int, std::string_view> nameOf(DOMtree &tree, DOMnodeUID node)
+        {
+            const DOMnode &n = tree._nodes(node);
+            return {n.isInnerDataNode() ? 0 : 1, n.isInnerDataNode() ? std::string_view() : std::string_view(n.getTagName())};
+        }
+
+        /**
+         *  @brief  Matches the children of a matched pair, sibling by sibling.
+         * */
+        void matchChildren(DOMnodeUID to_node, DOMnodeUID from_node)
+        {
+            from_children.assign(from._nodes(from_node).getChildrenUID().begin(), from._nodes(from_node).getChildrenUID().end());
+            to_children.assign(to._nodes(to_node).getChildrenUID().begin(), to._nodes(to_node).getChildrenUID().end());
+            for (std::size_t i = 0; i < from_children.size(); ++i)
+                position[from_children[i]] = i;
+
+            pairChildren(from_node, by_hash, [](DOMtree &tree, DOMnodeUID node) { return tree.getSubtreeHash(node); },
+                         [this](DOMnodeUID t, DOMnodeUID f) { matchExact(t, f); });
+
+            pairChildren(from_node, by_name, nameOf, [this](DOMnodeUID t, DOMnodeUID f) { matchUpdate(t, f); });
+
+            // renamed elements, paired in order with the elements left
+            std::size_t f = 0;
+            for (DOMnodeUID to_child : to_children)
+            {
+                if (match[to_child] != -1 || to._nodes(to_child).isInnerDataNode())
+                    continue;
+                while (f < from_children.size() &&
+                       (used[from_children[f]] != 0 || from._nodes(from_children[f]).isInnerDataNode()))
+                    ++f;
+                if (f == from_children.size())
+                    break;
+                matchUpdate(to_child, from_children[f]);
+            }
+        }
+
+        /**
+         *  @brief  Matches the nodes of to top-down, sibling by sibling.
+         * */
+        void matchSiblings()
+        {
+            std::vector<DOMnodeUID> pending{0};
+            matchUpdate(0, 0);
+            while (!pending.empty())
+            {
+                DOMnodeUID node = pending.back();
+                pending.pop_back();
+                if (exact[node] || match[node] < 0)
+                    continue;
+                matchChildren(node, match[node]);
+                for (DOMnodeUID child : to._nodes(node).getChildrenUID())
+                    pending.push_back(child);
+            }
+        }
+
+        /**
+         *  @brief  Matches the nodes of to left unmatched with unmatched subtrees
+         *          of from found anywhere by hash, or else marks them new.
+         * */
+        void matchMoved()
+        {
+            for (DOMnodeUID node = 1; node < DOMnodeUID(from.nodes.size()); ++node)
+                if (from.checkNodeExistance(node) && used[node] == 0 && !from._nodes(node).isInnerDataNode())
+                    from_by_hash[from.getSubtreeHash(node)].push_back(node);
+
+            std::vector<DOMnodeUID> pending{0};
+            while (!pending.empty())
+            {
+                DOMnodeUID node = pending.back();
+                pending.pop_back();
+                if (match[node] == -1)
+                {
+                    auto candidates = from_by_hash.find(to.getSubtreeHash(node));
+                    if (!to._nodes(node).isInnerDataNode() && candidates != from_by_hash.end())
+                    {
+                        auto &list = candidates->second;
+                        while (!list.empty() && used[list.back()] != 0)
+                            list.pop_back();
+                        if (!list.empty())
+                            matchExact(node, list.back());
+                    }
+                    if (match[node] == -1)
+                        match[node] = fresh;
+                }
+                if (exact[node])
+                    continue;
+                for (DOMnodeUID child : to._nodes(node).getChildrenUID())
+                    pending.push_back(child);
+            }
+        }
+
+        /**
+         *  @brief  Emits the edits of the attributes of a matched pair.
+         * */
+        void diffAttributes(DOMnodeUID to_node, DOMnodeUID from_node)
+        {
+            const DOMattributes &old_attributes = from._nodes(from_node).getAllAttributes();
+            const DOMattributes &new_attributes = to._nodes(to_node).getAllAttributes();
+            auto o = old_attributes.begin();
+            auto n = new_attributes.begin();
+            while (o != old_attributes.end() || n != new_attributes.end())
+            {
+                if (n == new_attributes.end() || (o != old_attributes.end() && o->first < n->first))
+                {
+                    DOMedit edit{DOMedit::kind::remove_attribute, from_node};
+                    edit.name = o->first;
+                    script.push_back(std::move(edit));
+                    ++o;
+                    continue;
+                }
+                if (o == old_attributes.end() || n->first < o->first || o->second != n->second)
+                {
+                    DOMedit edit{DOMedit::kind::set_attribute, from_node};
+                    edit.name = n->first;
+                    edit.value = n->second;
+                    script.push_back(std::move(edit));
+                }
+                if (o != old_attributes.end() && !(n->first < o->first))
+                    ++o;
+                ++n;
+            }
+        }
+
+        /**
+         *  @brief  Marks the children of to_node kept in place: those already
+         *          under the matched node, in the longest run of increasing
+         *          positions. The others are moved or inserted.
+         * */
+        void keepInPlace(DOMnodeUID to_node, std::vector<char> &keep)
+        {
+            keep.assign(to_children.size(), 0);
+            DOMnodeUID from_node = match[to_node];
+            if (from_node < 0)
+                return;
+
+            std::size_t index = 0;
+            for (DOMnodeUID child : from._nodes(from_node).getChildrenUID())
+                position[child] = index++;
+
+            // longest increasing subsequence of positions, patience sorting
+            std::vector<std::size_t> tails, previous(to_children.size(), std::size_t(-1));
+            for (std::size_t i = 0; i < to_children.size(); ++i)
+            {
+                DOMnodeUID m = match[to_children[i]];
+                if (m < 0 || from._nodes(m).getParent() != from_node)
+                    continue;
+                auto at = std::lower_bound(tails.begin(), tails.end(), i, [&](std::size_t a, std::size_t) {
+                    return position[match[to_children[a]]] < position[m];
+                });
+                if (at != tails.begin())
+                    previous[i] = *(at - 1);
+                if (at == tails.end())
+                    tails.push_back(i);
+                else
+                    *at = i;
+            }
+            for (std::size_t i = tails.empty() ? std::size_t(-1) : tails.back(); i != std::size_t(-1); i = previous[i])
+                keep[i] = 1;
+        }
+
+        /**
+         *  @brief  Emits the edits in preorder of to, then the removals.
+         * */
+        void emit()
+        {
+            std::vector<char> keep;
+            std::vector<DOMnodeUID> pending{0};
+            while (!pending.empty())
+            {
+                DOMnodeUID node = pending.back();
+                pending.pop_back();
+                DOMnodeUID m = match[node];
+                const DOMnode &target = to._nodes(node);
+
+                if (m >= 0) // matched with a node of from, update it
+                {
+                    const DOMnode &source = from._nodes(m);
+                    if (target.isInnerDataNode() && source.getInnerData() != target.getInnerData())
+                    {
+                        DOMedit edit{DOMedit::kind::set_text, m};
+                        edit.value = target.getInnerData();
+                        script.push_back(std::move(edit));
+                    }
+                    if (!target.isInnerDataNode() && source.getTagName() != target.getTagName())
+                    {
+                        DOMedit edit{DOMedit::kind::rename, m};
+                        edit.name = target.getTagName();
+                        script.push_back(std::move(edit));
+                    }
+                    if (!target.isInnerDataNode())
+                        diffAttributes(node, m);
+                }
+
+                to_children.assign(target.getChildrenUID().begin(), target.getChildrenUID().end());
+                keepInPlace(node, keep);
+                DOMnodeUID after = -1;
+                for (std::size_t i = 0; i < to_children.size(); ++i)
+                {
+                    DOMnodeUID child = to_children[i];
+                    DOMnodeUID c = match[child];
+                    if (c == fresh)
+                    {
+                        c = match[child] = DOMedit::inserted(inserted_count++);
+                        const DOMnode &n = to._nodes(child);
+                        DOMedit edit{n.isInnerDataNode() ? DOMedit::kind::insert_text : DOMedit::kind::insert_element, c, m, after};
+                        if (n.isInnerDataNode())
+                            edit.value = n.getInnerData();
+                        else
+                        {
+                            edit.name = n.getTagName();
+                            edit.attributes = n.getAllAttributes();
+                        }
+                        script.push_back(std::move(edit));
+                    }
+                    else if (!keep[i])
+                        script.push_back(DOMedit{DOMedit::kind::move, c, m, after});
+                    after = c;
+                }
+                for (auto child = target.getChildrenUID().rbegin(); child != target.getChildrenUID().rend(); ++child)
+                    if (!exact[*child])
+                        pending.push_back(*child);
+            }
+
+            for (DOMnodeUID node = 1; node < DOMnodeUID(from.nodes.size()); ++node)
+                if (from.checkNodeExistance(node) && used[node] != 1 && used[from._nodes(node).getParent()] == 1)
+                    script.push_back(DOMedit{DOMedit::kind::remove, node});
+        }
+
+        static inline DOMnodeUID resolve(DOMnodeUID ref, const std::vector<DOMnodeUID> &inserted)
+        {
+            if (ref >= -1)
+                return ref;
+            std::size_t i = -2 - ref;
+            return i < inserted.size() ? inserted[i] : -1;
+        }
+
+    public:
+        tree_differ(DOMtree &_from, DOMtree &_to)
+            : from(_from), to(_to) {}
+
+        /**
+         *  @brief  Computes the edits turning from into to.
+         * */
+        DOMeditScript run()
+        {
+            script.clear();
+            inserted_count = 0;
+            if (!from.checkNodeExistance(0) || !to.checkNodeExistance(0) ||
+                from.getSubtreeHash(0) == to.getSubtreeHash(0))
+                return script;
+            match.assign(to.nodes.size(), -1);
+            exact.assign(to.nodes.size(), 0);
+            used.assign(from.nodes.size(), 0);
+            position.assign(from.nodes.size(), 0);
+            from_by_hash.clear();
+
+            matchSiblings();
+            matchMoved();
+            emit();
+            return std::move(script);
+        }
+
+        /**
+         *  @brief  Applies an edit script to the tree.
+         *  @return -2  if an edit does not fit the tree, the edits before it
+         *              stay applied
+         *          0   if applied successfully
+         * */
+        static int apply(DOMtree &tree, const DOMeditScript &edits)
+        {
+            std::vector<DOMnodeUID> inserted;
+            for (const DOMedit &edit : edits)
+            {
+                DOMnodeUID node = resolve(edit.node, inserted);
+                DOMnodeUID parent = resolve(edit.parent, inserted);
+                DOMnodeUID after = resolve(edit.after, inserted);
+                if (edit.after < -1 && after == -1)
+                    return -2;
+                bool done = false;
+                switch (edit.type)
+                {
+                case DOMedit::kind::insert_element:
+                case DOMedit::kind::insert_text:
+                    if (edit.node != DOMedit::inserted(inserted.size()))
+                        return -2;
+                    if (edit.type == DOMedit::kind::insert_text)
+                        node = tree.addInnerDataNode(parent, edit.value, after);
+                    else if ((node = tree.addNode(parent, edit.name, after)) != -1)
+                    {
+                        tree.getNode(node).setAttributes(edit.attributes);
+                        tree.invalidateHash(node);
+                    }
+                    inserted.push_back(node);
+                    done = (node != -1);
+                    break;
+                case DOMedit::kind::move:
+                    done = tree.moveSubtree(node, parent, after);
+                    break;
+                case DOMedit::kind::remove:
+                    done = tree.checkNodeExistance(node);
+                    tree.deleteSubtree(node);
+                    break;
+                case DOMedit::kind::rename:
+                    done = tree.setTagName(node, edit.name);
+                    break;
+                case DOMedit::kind::set_text:
+                    done = tree.setInnerData(node, edit.value);
+                    break;
+                case DOMedit::kind::set_attribute:
+                    done = tree.setAttribute(node, edit.name, edit.value);
+                    break;
+                case DOMedit::kind::remove_attribute:
+                    done = tree.removeAttribute(node, edit.name);
+                    break;
+                }
+                if (!done)
+                    return -2;
+            }
+            return 0;
+        }
+    };
+
+    /**
+     *  @brief  Computes an edit script turning one tree into another. UIDs in
+     *          the script are those of from, so it applies to from or to any
+     *          tree with the same nodes under the same UIDs, e.g. the same
+     *          document loaded the same way on another machine.
+     *  @param  from    old tree, its subtree hashes get cached
+     *  @param  to      new tree, its subtree hashes get cached
+     * */
+    inline DOMeditScript diff(DOMtree &from, DOMtree &to)
+    {
+        return tree_differ(from, to).run();
+    }
+
+    /**
+     *  @brief  Applies an edit script computed by diff(). Not named apply so
+     *          that unqualified calls do not find std::apply through the script.
+     *  @return -2  if an edit does not fit the tree, the edits before it
+     *              stay applied
+     *          0   if applied successfully
+     * */
+    inline int patch(DOMtree &tree, const DOMeditScript &script)
+    {
+        return tree_differ::apply(tree, script);
+    }
+} // namespace dom_parser
+
+#endif
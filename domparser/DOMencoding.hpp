@@ -0,0 +1,341 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_ENCODING
+#define DOM_PARSER_DOM_ENCODING
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "DOMentities.hpp"
+#include "DOMinput.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Encodings the lexer accepts. Everything other than UTF-8 is
+     *          transcoded to UTF-8 before lexing.
+     * */
+    enum class text_encoding
+    {
+        utf8,
+        utf16le,
+        utf16be,
+        latin1
+    };
+
+    /**
+     *  @brief  Case insensitive comparison of an encoding name.
+     * */
+    inline bool _encoding_name_is(const char *name, std::size_t length, const char *expected)
+    {
+        if (std::strlen(expected) != length)
+            return false;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            char c = name[i];
+            if (c >= 'a' && c <= 'z')
+                c = c - 'a' + 'A';
+            if (c != expected[i])
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     *  @brief  Detects the encoding from the byte order mark, the layout of
+     *          "<?" in UTF-16 without a BOM or the encoding declared in
+     *          <?xml ... ?>. Defaults to UTF-8.
+     *  @param  data        beginning of the input
+     *  @param  size        number of bytes available
+     *  @param  bom_length  set to the length of the BOM to be skipped
+     * */
+    inline text_encoding detect_encoding(const char *data, std::size_t size, std::size_t &bom_length)
+    {
+        const unsigned char *u = reinterpret_cast<const unsigned char *>(data);
+        bom_length = 0;
+
+        if (size >= 3 && u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF)
+        {
+            bom_length = 3;
+            return text_encoding::utf8;
+        }
+        if (size >= 2 && u[0] == 0xFF && u[1] == 0xFE)
+        {
+            bom_length = 2;
+            return text_encoding::utf16le;
+        }
+        if (size >= 2 && u[0] == 0xFE && u[1] == 0xFF)
+        {
+            bom_length = 2;
+            return text_encoding::utf16be;
+        }
+        if (size >= 4 && u[0] == '<' && u[1] == 0 && u[2] == '?' && u[3] == 0)
+            return text_encoding::utf16le;
+        if (size >= 4 && u[0] == 0 && u[1] == '<' && u[2] == 0 && u[3] == '?')
+            return text_encoding::utf16be;
+
+        // look for encoding="..." inside the <?xml ... ?> declaration
+        if (size < 5 || std::memcmp(data, "<?xml", 5) != 0)
+            return text_encoding::utf8;
+        std::string prolog(data, size);
+        std::size_t end = prolog.find("?>");
+        std::size_t pos = prolog.find("encoding", 5);
+        if (end == std::string::npos || pos == std::string::npos || pos > end)
+            return text_encoding::utf8;
+        pos = prolog.find_first_of("\"\'", pos);
+        if (pos == std::string::npos || pos > end)
+            return text_encoding::utf8;
+        std::size_t close = prolog.find(prolog[pos], pos + 1);
+        if (close == std::string::npos || close > end)
+            return text_encoding::utf8;
+
+        const char *name = data + pos + 1;
+        std::size_t length = close - pos - 1;
+        if (_encoding_name_is(name, length, "ISO-8859-1") ||
+            _encoding_name_is(name, length, "ISO_8859-1") ||
+            _encoding_name_is(name, length, "LATIN1"))
+            return text_encoding::latin1;
+        return text_encoding::utf8;
+    }
+
+    /**
+     *  @brief  Streaming UTF-8 validator. Rejects overlong forms, surrogates,
+     *          code points above U+10FFFF and truncated sequences, also when
+     *          a sequence is split between two chunks. Runs of ASCII are
+     *          skipped 16 bytes at a time with SSE2, or 8 bytes at a time
+     *          with plain 64-bit words where SSE2 is not available.
+     * */
+    class utf8_validator
+    {
+    private:
+        unsigned need = 0;          // continuation bytes still expected
+        unsigned char lower = 0x80; // bounds of the next continuation byte
+        unsigned char upper = 0xBF;
+        std::size_t validated = 0;  // bytes validated in previous chunks
+        std::size_t error_at = std::size_t(-1);
+
+        /**
+         *  @brief  Returns index of the first non-ASCII byte at or after i.
+         * */
+        static inline std::size_t skip_ascii(const unsigned char *data, std::size_t i, std::size_t size)
+        {
+#ifdef __SSE2__
+            for (; i + 16 <= size; i += 16)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                if (_mm_movemask_epi8(block) != 0)
+                    break;
+            }
+#endif
+            for (; i + 8 <= size; i += 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                if (word & 0x8080808080808080ULL)
+                    break;
+            }
+            while (i < size && data[i] < 0x80)
+                ++i;
+            return i;
+        }
+
+    public:
+        /**
+         *  @brief  Validates the next chunk of the input.
+         *  @return false if an invalid byte was found, see error_offset()
+         * */
+        bool validate(const char *chunk, std::size_t size)
+        {
+            const unsigned char *data = reinterpret_cast<const unsigned char *>(chunk);
+            std::size_t i = 0;
+            while (i < size)
+            {
+                if (need == 0)
+                {
+                    i = skip_ascii(data, i, size);
+                    if (i == size)
+                        break;
+
+                    unsigned char c = data[i];
+                    if (c < 0xC2 || c > 0xF4)
+                    {
+                        error_at = validated + i;
+                        return false;
+                    }
+                    else if (c < 0xE0)
+                        need = 1;
+                    else if (c < 0xF0)
+                    {
+                        need = 2;
+                        lower = (c == 0xE0) ? 0xA0 : 0x80; // overlong
+                        upper = (c == 0xED) ? 0x9F : 0xBF; // surrogates
+                    }
+                    else
+                    {
+                        need = 3;
+                        lower = (c == 0xF0) ? 0x90 : 0x80; // overlong
+                        upper = (c == 0xF4) ? 0x8F : 0xBF; // above U+10FFFF
+                    }
+                }
+                else
+                {
+                    unsigned char c = data[i];
+                    if (c < lower || c > upper)
+                    {
+                        error_at = validated + i;
+                        return false;
+                    }
+                    lower = 0x80;
+                    upper = 0xBF;
+                    --need;
+                }
+                ++i;
+            }
+            validated += size;
+            return true;
+        }
+
+        /**
+         *  @brief  Checks that the input did not end inside a sequence.
+         * */
+        bool finish()
+        {
+            if (need != 0)
+            {
+                error_at = validated;
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         *  @brief  Returns the byte offset of the first invalid byte.
+         * */
+        inline std::size_t error_offset()
+        {
+            return error_at;
+        }
+    };
+
+    /**
+     *  @brief  Converts UTF-16 or Latin-1 input from another source to UTF-8.
+     * */
+    class transcoding_source : public input_source
+    {
+    private:
+        std::unique_ptr<input_source> source;
+        text_encoding encoding;
+        std::string raw; // bytes read from the source and not yet converted
+        std::size_t raw_pos = 0;
+        bool source_done = false;
+        bool error = false;
+
+        /**
+         *  @brief  Makes sure at least n unconverted bytes are available,
+         *          unless the source is finished.
+         * */
+        bool fetch(std::size_t n)
+        {
+            while (raw.size() - raw_pos < n && !source_done)
+            {
+                raw.erase(0, raw_pos);
+                raw_pos = 0;
+                std::size_t old_size = raw.size();
+                raw.resize(old_size + 65536);
+                std::size_t got = source->read(&raw[old_size], 65536);
+                raw.resize(old_size + got);
+                if (got == 0)
+                    source_done = true;
+            }
+            return raw.size() - raw_pos >= n;
+        }
+
+        inline unsigned long unit16(std::size_t pos)
+        {
+            const unsigned char *u = reinterpret_cast<const unsigned char *>(raw.data() + pos);
+            return encoding == text_encoding::utf16le ? (u[0] | (u[1] << 8)) : ((u[0] << 8) | u[1]);
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _source     source providing the encoded input
+         *  @param  _encoding   encoding of the input, not UTF-8
+         *  @param  prefix      bytes already taken from the source, after the BOM
+         * */
+        transcoding_source(std::unique_ptr<input_source> &&_source, text_encoding _encoding, std::string &&prefix)
+            : source(std::move(_source)), encoding(_encoding), raw(std::move(prefix)) {}
+
+        std::size_t read(char *buff, std::size_t size) override
+        {
+            std::size_t w = 0;
+            while (w + 4 <= size && !error)
+            {
+                if (encoding == text_encoding::latin1)
+                {
+                    if (!fetch(1))
+                        break;
+                    w += encode_utf8(static_cast<unsigned char>(raw[raw_pos]), buff + w);
+                    raw_pos += 1;
+                    continue;
+                }
+
+                if (!fetch(2))
+                {
+                    error = (raw.size() != raw_pos); // odd number of bytes
+                    break;
+                }
+                unsigned long code_point = unit16(raw_pos);
+                if (code_point >= 0xDC00 && code_point <= 0xDFFF) // unpaired low surrogate
+                    error = true;
+                else if (code_point >= 0xD800 && code_point <= 0xDBFF)
+                {
+                    unsigned long low;
+                    if (!fetch(4) || (low = unit16(raw_pos + 2)) < 0xDC00 || low > 0xDFFF)
+                        error = true;
+                    else
+                    {
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        raw_pos += 2;
+                    }
+                }
+                if (error)
+                    break;
+                raw_pos += 2;
+                w += encode_utf8(code_point, buff + w);
+            }
+            return w;
+        }
+
+        bool is_open() override
+        {
+            return source->is_open();
+        }
+
+        bool failed() override
+        {
+            return error;
+        }
+    };
+} // namespace dom_parser
+
+#endif
@@ -0,0 +1,202 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_ENTITIES
+#define DOM_PARSER_DOM_ENTITIES
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Encodes a code point as UTF-8 at the given position.
+     *  @return number of bytes written
+     * */
+    inline std::size_t encode_utf8(unsigned long code_point, char *out)
+    {
+        if (code_point < 0x80)
+        {
+            out[0] = char(code_point);
+            return 1;
+        }
+        if (code_point < 0x800)
+        {
+            out[0] = char(0xC0 | (code_point >> 6));
+            out[1] = char(0x80 | (code_point & 0x3F));
+            return 2;
+        }
+        if (code_point < 0x10000)
+        {
+            out[0] = char(0xE0 | (code_point >> 12));
+            out[1] = char(0x80 | ((code_point >> 6) & 0x3F));
+            out[2] = char(0x80 | (code_point & 0x3F));
+            return 3;
+        }
+        out[0] = char(0xF0 | (code_point >> 18));
+        out[1] = char(0x80 | ((code_point >> 12) & 0x3F));
+        out[2] = char(0x80 | ((code_point >> 6) & 0x3F));
+        out[3] = char(0x80 | (code_point & 0x3F));
+        return 4;
+    }
+
+    /**
+     *  @brief  Decodes one reference, the text between '&' and ';'.
+     *  @param  name    first char after '&'
+     *  @param  length  number of chars till ';'
+     *  @param  out     where the decoded chars are written, at most 4
+     *  @return number of chars written, 0 if the reference is not known
+     * */
+    inline std::size_t decode_reference(const char *name, std::size_t length, char *out)
+    {
+        if (length >= 2 && name[0] == '#')
+        {
+            unsigned long code_point = 0;
+            bool hex = (name[1] == 'x');
+            std::size_t i = hex ? 2 : 1;
+            if (i == length)
+                return 0;
+            for (; i < length; ++i)
+            {
+                char c = name[i];
+                unsigned digit;
+                if (c >= '0' && c <= '9')
+                    digit = c - '0';
+                else if (hex && c >= 'a' && c <= 'f')
+                    digit = c - 'a' + 10;
+                else if (hex && c >= 'A' && c <= 'F')
+                    digit = c - 'A' + 10;
+                else
+                    return 0;
+                code_point = code_point * (hex ? 16 : 10) + digit;
+                if (code_point > 0x10FFFF)
+                    return 0;
+            }
+            if (code_point == 0 || (code_point >= 0xD800 && code_point <= 0xDFFF))
+                return 0;
+            return encode_utf8(code_point, out);
+        }
+
+        char c;
+        if (length == 2 && name[0] == 'l' && name[1] == 't')
+            c = '<';
+        else if (length == 2 && name[0] == 'g' && name[1] == 't')
+            c = '>';
+        else if (length == 3 && std::memcmp(name, "amp", 3) == 0)
+            c = '&';
+        else if (length == 4 && std::memcmp(name, "quot", 4) == 0)
+            c = '\"';
+        else if (length == 4 && std::memcmp(name, "apos", 4) == 0)
+            c = '\'';
+        else
+            return 0;
+        out[0] = c;
+        return 1;
+    }
+
+    /**
+     *  @brief  Decodes predefined entities and character references in place.
+     *          A decoded reference is never longer than its source, so the
+     *          string is rewritten front to back without a second buffer.
+     *          Unknown or malformed references are kept as they are.
+     *  @return true if anything was decoded, false if the string is untouched
+     * */
+    inline bool decode_entities(std::string &s)
+    {
+        // longest reference we decode is "&#x10FFFF;" or "&#1114111;"
+        const std::size_t max_reference = 10;
+
+        char *data = &s[0];
+        std::size_t n = s.size();
+        const char *amp = static_cast<const char *>(std::memchr(data, '&', n));
+        if (amp == nullptr)
+            return false;
+
+        std::size_t r = amp - data, w = r;
+        bool decoded = false;
+        while (r < n)
+        {
+            if (data[r] != '&')
+            {
+                // copy the run of plain chars up to the next '&'
+                amp = static_cast<const char *>(std::memchr(data + r, '&', n - r));
+                std::size_t run = (amp == nullptr ? n : amp - data) - r;
+                std::memmove(data + w, data + r, run);
+                w += run;
+                r += run;
+                continue;
+            }
+
+            std::size_t limit = std::min(n - r, max_reference);
+            const char *semi = static_cast<const char *>(std::memchr(data + r + 1, ';', limit - 1));
+            std::size_t written = 0;
+            if (semi != nullptr)
+            {
+                char buff[4];
+                written = decode_reference(data + r + 1, semi - (data + r + 1), buff);
+                if (written != 0)
+                {
+                    std::memcpy(data + w, buff, written);
+                    w += written;
+                    r = semi - data + 1;
+                    decoded = true;
+                }
+            }
+            if (written == 0) // keep the '&' as it is
+                data[w++] = data[r++];
+        }
+        s.resize(w);
+        return decoded;
+    }
+
+    /**
+     *  @brief  Appends the string to out, escaping the chars that cannot
+     *          appear literally. Runs without such chars are appended in one go.
+     *  @param  out         output string
+     *  @param  in          string to escape
+     *  @param  attribute   true if in is an attribute value, then double quotes
+     *                      are escaped as well
+     * */
+    inline void append_escaped(std::string &out, const std::string &in, bool attribute)
+    {
+        const char *special = attribute ? "&<>\"" : "&<>";
+        std::size_t begin = 0;
+        std::size_t pos;
+        while ((pos = in.find_first_of(special, begin)) != std::string::npos)
+        {
+            out.append(in, begin, pos - begin);
+            switch (in[pos])
+            {
+            case '&':
+                out += "&amp;";
+                break;
+            case '<':
+                out += "&lt;";
+                break;
+            case '>':
+                out += "&gt;";
+                break;
+            case '\"':
+                out += "&quot;";
+                break;
+            }
+            begin = pos + 1;
+        }
+        out.append(in, begin, std::string::npos);
+    }
+} // namespace dom_parser
+
+#endif
@@ -0,0 +1,63 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_HASH
+#define DOM_PARSER_DOM_HASH
+
+#include <cstdint>
+#include <string_view>
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Finalizer of splitmix64, spreads every input bit over the
+     *          whole result.
+     * */
+    constexpr std::uint64_t hash_mix(std::uint64_t h)
+    {
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+
+    /**
+     *  @brief  Folds a value into a running hash, order sensitive.
+     * */
+    constexpr std::uint64_t hash_combine(std::uint64_t h, std::uint64_t value)
+    {
+        return hash_mix(h ^ (value + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+    }
+
+    /**
+     *  @brief  Folds a string into a running hash. The length goes in first
+     *          so that adjacent strings cannot trade bytes. The result is the
+     *          same on every platform and run, so hashes can be stored.
+     * */
+    inline std::uint64_t hash_string(std::uint64_t h, std::string_view s)
+    {
+        std::uint64_t fnv = 0xcbf29ce484222325ULL; // FNV-1a
+        for (char c : s)
+        {
+            fnv ^= static_cast<unsigned char>(c);
+            fnv *= 0x100000001b3ULL;
+        }
+        return hash_combine(hash_combine(h, s.size()), fnv);
+    }
+} // namespace dom_parser
+
+#endif
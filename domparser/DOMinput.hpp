@@ -0,0 +1,541 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_INPUT
+#define DOM_PARSER_DOM_INPUT
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Compressed input needs the library and linking against it (-lz, -lzstd),
+// so each format is only built when asked for.
+#ifdef DOM_PARSER_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DOM_PARSER_USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Source of raw input bytes for the lexer.
+     * */
+    class input_source
+    {
+    public:
+        virtual ~input_source() {}
+
+        /**
+         *  @brief  Reads up to size bytes into buff.
+         *  @return number of bytes read, 0 once the input is finished
+         * */
+        virtual std::size_t read(char *buff, std::size_t size) = 0;
+
+        /**
+         *  @brief  Checks if the source could be opened.
+         * */
+        virtual bool is_open()
+        {
+            return true;
+        }
+
+        /**
+         *  @brief  Checks if the input ended because of an error.
+         * */
+        virtual bool failed()
+        {
+            return false;
+        }
+    };
+
+    /**
+     *  @brief  Reads the input from a file.
+     * */
+    class file_source : public input_source
+    {
+    private:
+        std::ifstream fin;
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  path    path of the file to be read
+         * */
+        file_source(const std::filesystem::path &path)
+            : fin(path, std::ios::binary) {}
+
+        std::size_t read(char *buff, std::size_t size) override
+        {
+            fin.read(buff, size);
+            return fin.gcount();
+        }
+
+        bool is_open() override
+        {
+            return fin.is_open();
+        }
+    };
+
+    /**
+     *  @brief  Reads the input from a string held in memory.
+     * */
+    class memory_source : public input_source
+    {
+    private:
+        std::string data;
+        std::size_t pos = 0;
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _data   the input, moved into the source
+         * */
+        memory_source(std::string &&_data)
+            : data(std::move(_data)) {}
+
+        /**
+         *  @brief  Constructor
+         *  @param  _data   the input, copied into the source
+         * */
+        memory_source(const std::string &_data)
+            : data(_data) {}
+
+        std::size_t read(char *buff, std::size_t size) override
+        {
+            std::size_t n = std::min(size, data.size() - pos);
+            std::memcpy(buff, data.data() + pos, n);
+            pos += n;
+            return n;
+        }
+    };
+
+    /**
+     *  @brief  Reads the input from memory owned by the caller, which must
+     *          outlive the source.
+     * */
+    class view_source : public input_source
+    {
+    private:
+        std::string_view data;
+        std::size_t pos = 0;
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _data   the input, not copied
+         * */
+        view_source(std::string_view _data)
+            : data(_data) {}
+
+        std::size_t read(char *buff, std::size_t size) override
+        {
+            std::size_t n = std::min(size, data.size() - pos);
+            std::memcpy(buff, data.data() + pos, n);
+            pos += n;
+            return n;
+        }
+    };
+
+    /**
+     *  @brief  Reads another source ahead on a background thread. Two large
+     *          blocks are used in turn: while one is being consumed by read()
+     *          the thread fills the other, so parsing overlaps with waiting
+     *          for the disk.
+     * */
+    class readahead_source : public input_source
+    {
+    private:
+        std::unique_ptr<input_source> source;
+        std::vector<char> blocks[2];
+        std::size_t filled[2] = {0, 0};
+        bool ready[2] = {false, false}; // filled and not consumed yet
+        int current = 0;                // block consumed by read()
+        std::size_t pos = 0;
+        bool stop = false;
+        bool source_open;
+        bool source_failed = false;
+
+        std::mutex lock;
+        std::condition_variable changed;
+        std::thread reader;
+
+        /**
+         *  @brief  Fills the blocks in turn until the source ends. An empty
+         *          block marks the end of the input.
+         * */
+        void read_ahead()
+        {
+            for (int b = 0;; b ^= 1)
+            {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&] { return stop || !ready[b]; });
+                    if (stop)
+                        return;
+                }
+
+                std::vector<char> &block = blocks[b];
+                std::size_t n = 0;
+                while (n < block.size())
+                {
+                    std::size_t got = source->read(block.data() + n, block.size() - n);
+                    if (got == 0)
+                        break;
+                    n += got;
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                filled[b] = n;
+                ready[b] = true;
+                changed.notify_all();
+                if (n == 0)
+                {
+                    source_failed = source->failed();
+                    return;
+                }
+            }
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _source     source to be read ahead
+         *  @param  block_size  size of each of the two blocks
+         * */
+        readahead_source(std::unique_ptr<input_source> &&_source, std::size_t block_size = 1 << 20)
+            : source(std::move(_source)), source_open(source->is_open())
+        {
+            if (!source_open)
+                return;
+            blocks[0].resize(block_size);
+            blocks[1].resize(block_size);
+            reader = std::thread(&readahead_source::read_ahead, this);
+        }
+
+        ~readahead_source()
+        {
+            if (!reader.joinable())
+                return;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop = true;
+            }
+            changed.notify_all();
+            reader.join();
+        }
+
+        std::size_t read(char *buff, std::size_t size) override
+        {
+            if (!source_open)
+                return 0;
+
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return ready[current]; });
+            if (filled[current] == 0)
+                return 0; // end of input, the block stays ready
+            guard.unlock(); // the reader does not touch a ready block
+
+            std::size_t n = std::min(size, filled[current] - pos);
+            std::memcpy(buff, blocks[current].data() + pos, n);
+            pos += n;
+            if (pos == filled[current])
+            {
+                guard.lock();
+                ready[current] = false;
+                changed.notify_all();
+                current ^= 1;
+                pos = 0;
+            }
+            return n;
+        }
+
+        bool is_open() override
+        {
+            return source_open;
+        }
+
+        bool failed() override
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return source_failed;
+        }
+    };
+
+    /**
+     *  @brief  Compression formats recognized by their magic bytes.
+     * */
+    enum class compression
+    {
+        none,
+        gzip,
+        zstd
+    };
+
+    /**
+     *  @brief  Detects the compression of the input from its first bytes.
+     *  @param  data    start of the input
+     *  @param  length  number of bytes available
+     * */
+    inline compression detect_compression(const char *data, std::size_t length)
+    {
+        const unsigned char *u = reinterpret_cast<const unsigned char *>(data);
+        if (length >= 2 && u[0] == 0x1f && u[1] == 0x8b)
+            return compression::gzip;
+        if (length >= 4 && u[0] == 0x28 && u[1] == 0xb5 && u[2] == 0x2f && u[3] == 0xfd)
+            return compression::zstd;
+        return compression::none;
+    }
+
+    /**
+     *  @brief  Detects the compression of a file from its first bytes.
+     *  @param  path    path of the file
+     * */
+    inline compression detect_compression(const std::filesystem::path &path)
+    {
+        char magic[4];
+        std::ifstream fin(path, std::ios::binary);
+        fin.read(magic, sizeof(magic));
+        return detect_compression(magic, static_cast<std::size_t>(fin.gcount()));
+    }
+
+#ifdef DOM_PARSER_USE_ZLIB
+    /**
+     *  @brief  Decompresses gzip (or zlib) input read from another source.
+     *          Concatenated gzip members are read one after another.
+     * */
+    class gzip_source : public input_source
+    {
+    private:
+        std::unique_ptr<input_source> source;
+        z_stream stream;
+        std::vector<char> input;
+        bool ready;
+        bool source_done = false;
+        bool finished = false;
+        bool error = false;
+
+        /**
+         *  @brief  Reads more compressed bytes once the previous ones are used.
+         * */
+        void fetch()
+        {
+            if (stream.avail_in != 0 || source_done)
+                return;
+            std::size_t got = source->read(input.data(), input.size());
+            if (got == 0)
+                source_done = true;
+            stream.next_in = reinterpret_cast<Bytef *>(input.data());
+            stream.avail_in = static_cast<uInt>(got);
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _source     source providing the compressed input
+         * */
+        gzip_source(std::unique_ptr<input_source> &&_source)
+            : source(std::move(_source)), stream(), input(1 << 16)
+        {
+            ready = inflateInit2(&stream, 15 + 32) == Z_OK; // 32: detect gzip or zlib header
+        }
+
+        ~gzip_source()
+        {
+            if (ready)
+                inflateEnd(&stream);
+        }
+
+        std::size_t read(char *buff, std::size_t size) override
+        {
+            if (!ready || finished || error)
+                return 0;
+
+            size = std::min<std::size_t>(size, 1u << 30);
+            stream.next_out = reinterpret_cast<Bytef *>(buff);
+            stream.avail_out = static_cast<uInt>(size);
+            while (stream.avail_out != 0)
+            {
+                fetch();
+                int res = inflate(&stream, Z_NO_FLUSH);
+                if (res == Z_STREAM_END)
+                {
+                    fetch();
+                    if (stream.avail_in == 0)
+                    {
+                        finished = true;
+                        break;
+                    }
+                    inflateReset(&stream); // next member
+                }
+                else if (res == Z_BUF_ERROR && source_done)
+                {
+                    error = true; // truncated input
+                    break;
+                }
+                else if (res != Z_OK && res != Z_BUF_ERROR)
+                {
+                    error = true;
+                    break;
+                }
+            }
+            return size - stream.avail_out;
+        }
+
+        bool is_open() override
+        {
+            return ready && source->is_open();
+        }
+
+        bool failed() override
+        {
+            return error || source->failed();
+        }
+    };
+#endif
+
+#ifdef DOM_PARSER_USE_ZSTD
+    /**
+     *  @brief  Decompresses zstd input read from another source. Concatenated
+     *          frames are read one after another.
+     * */
+    class zstd_source : public input_source
+    {
+    private:
+        std::unique_ptr<input_source> source;
+        ZSTD_DStream *stream;
+        std::vector<char> input;
+        ZSTD_inBuffer in = {nullptr, 0, 0};
+        bool source_done = false;
+        bool frame_done = true; // no frame is partially decoded
+        bool finished = false;
+        bool error = false;
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  _source     source providing the compressed input
+         * */
+        zstd_source(std::unique_ptr<input_source> &&_source)
+            : source(std::move(_source)), stream(ZSTD_createDStream()), input(ZSTD_DStreamInSize())
+        {
+            if (stream)
+                ZSTD_initDStream(stream);
+            in.src = input.data();
+        }
+
+        ~zstd_source()
+        {
+            ZSTD_freeDStream(stream);
+        }
+
+        std::size_t read(char *buff, std::size_t size) override
+        {
+            if (!stream || finished || error)
+                return 0;
+
+            ZSTD_outBuffer out = {buff, size, 0};
+            while (out.pos < out.size)
+            {
+                if (in.pos == in.size && !source_done)
+                {
+                    in.size = source->read(input.data(), input.size());
+                    in.pos = 0;
+                    if (in.size == 0)
+                        source_done = true;
+                }
+
+                std::size_t before = out.pos, consumed = in.pos;
+                std::size_t res = ZSTD_decompressStream(stream, &out, &in);
+                if (ZSTD_isError(res))
+                {
+                    error = true;
+                    break;
+                }
+                if (out.pos == before && in.pos == consumed)
+                {
+                    if (source_done)
+                    {
+                        finished = true;
+                        error = !frame_done; // truncated input
+                    }
+                    break;
+                }
+                frame_done = res == 0;
+            }
+            return out.pos;
+        }
+
+        bool is_open() override
+        {
+            return stream && source->is_open();
+        }
+
+        bool failed() override
+        {
+            return error || source->failed();
+        }
+    };
+#endif
+
+    /**
+     *  @brief  Opens a file for reading. Compressed files are decompressed
+     *          on a background thread, which pipelines the decompression with
+     *          the parse. Other files of at least readahead_min bytes are read
+     *          ahead on a background thread, smaller ones are read directly
+     *          since starting the thread would cost more than it saves.
+     *          A compressed file whose format was not built in is read as is.
+     *  @param  path            path of the file to be read
+     *  @param  readahead_min   smallest uncompressed file size which is read ahead
+     * */
+    inline std::unique_ptr<input_source> open_file_source(const std::filesystem::path &path,
+                                                          std::uintmax_t readahead_min = 1 << 20)
+    {
+        std::unique_ptr<input_source> file(new file_source(path));
+        switch (detect_compression(path))
+        {
+#ifdef DOM_PARSER_USE_ZLIB
+        case compression::gzip:
+            file.reset(new gzip_source(std::move(file)));
+            return std::unique_ptr<input_source>(new readahead_source(std::move(file)));
+#endif
+#ifdef DOM_PARSER_USE_ZSTD
+        case compression::zstd:
+            file.reset(new zstd_source(std::move(file)));
+            return std::unique_ptr<input_source>(new readahead_source(std::move(file)));
+#endif
+        default:
+            break;
+        }
+
+        std::error_code ec;
+        std::uintmax_t size = std::filesystem::file_size(path, ec);
+        if (ec || size < readahead_min)
+            return file;
+        return std::unique_ptr<input_source>(new readahead_source(std::move(file)));
+    }
+} // namespace dom_parser
+
+#endif
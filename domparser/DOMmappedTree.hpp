@@ -0,0 +1,461 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_MAPPED_TREE
+#define DOM_PARSER_DOM_MAPPED_TREE
+
+#include "DOMmmap.hpp"
+
+#ifdef DOM_PARSER_HAS_MMAP
+
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "DOMnodeUID.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Node as stored in the node file of DOMmappedTree.
+     * */
+    struct mapped_node_record
+    {
+        DOMnodeUID parent;
+        DOMnodeUID first_child;
+        DOMnodeUID last_child;
+        DOMnodeUID next_sibling;
+        std::uint64_t text_offset;     // tag name, or the inner data of inner-data nodes
+        std::uint64_t attribute_begin; // index of the first attribute record
+        std::uint32_t text_length;
+        std::uint32_t attribute_count;
+        std::uint32_t inner_data;
+    };
+
+    /**
+     *  @brief  Attribute as stored in the attribute file of DOMmappedTree.
+     * */
+    struct mapped_attribute_record
+    {
+        std::uint64_t name_offset;
+        std::uint64_t value_offset;
+        std::uint32_t name_length;
+        std::uint32_t value_length;
+    };
+
+    class DOMmappedTree;
+
+    /**
+     *  @brief  Read only view of a node in a DOMmappedTree, offering the
+     *          navigation API of DOMnode with two differences: strings are
+     *          returned as views into the mapping, valid while the tree is not
+     *          appended to, and getChildrenUID() returns a children_range
+     *          walking the sibling links instead of a std::list. getNode()
+     *          of DOMmappedTree returns the view by value for the same reason.
+     * */
+    class DOMmappedNode
+    {
+    private:
+        const DOMmappedTree *tree;
+        DOMnodeUID uid;
+
+        inline const mapped_node_record &record() const;
+        inline std::string_view text(std::uint64_t offset, std::uint32_t length) const;
+        inline const mapped_attribute_record &attribute_record(std::uint64_t index) const;
+
+    public:
+        /**
+         *  @brief  Range over the children UIDs, following the sibling links.
+         * */
+        class children_range
+        {
+        private:
+            const DOMmappedTree *tree;
+            DOMnodeUID first;
+
+        public:
+            class iterator
+            {
+            private:
+                const DOMmappedTree *tree;
+                DOMnodeUID uid;
+
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef DOMnodeUID value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const DOMnodeUID *pointer;
+                typedef const DOMnodeUID &reference;
+
+                iterator(const DOMmappedTree *_tree, DOMnodeUID _uid)
+                    : tree(_tree), uid(_uid) {}
+                inline DOMnodeUID operator*() const
+                {
+                    return uid;
+                }
+                inline iterator &operator++();
+                inline bool operator==(const iterator &other) const
+                {
+                    return uid == other.uid;
+                }
+                inline bool operator!=(const iterator &other) const
+                {
+                    return uid != other.uid;
+                }
+            };
+
+            children_range(const DOMmappedTree *_tree, DOMnodeUID _first)
+                : tree(_tree), first(_first) {}
+            inline iterator begin() const
+            {
+                return iterator(tree, first);
+            }
+            inline iterator end() const
+            {
+                return iterator(tree, -1);
+            }
+            inline bool empty() const
+            {
+                return first == -1;
+            }
+        };
+
+        DOMmappedNode(const DOMmappedTree *_tree, DOMnodeUID _uid)
+            : tree(_tree), uid(_uid) {}
+
+        inline DOMnodeUID getUID() const
+        {
+            return uid;
+        }
+
+        inline DOMnodeUID getParent() const
+        {
+            return record().parent;
+        }
+
+        inline bool isInnerDataNode() const
+        {
+            return record().inner_data != 0;
+        }
+
+        /**
+         *  @brief  Returns the tag name, empty for inner-data nodes.
+         * */
+        inline std::string_view getTagName() const
+        {
+            const mapped_node_record &r = record();
+            return r.inner_data ? std::string_view() : text(r.text_offset, r.text_length);
+        }
+
+        /**
+         *  @brief  Returns the inner data, empty for element nodes.
+         * */
+        inline std::string_view getInnerData() const
+        {
+            const mapped_node_record &r = record();
+            return r.inner_data ? text(r.text_offset, r.text_length) : std::string_view();
+        }
+
+        inline children_range getChildrenUID() const
+        {
+            return children_range(tree, record().first_child);
+        }
+
+        inline std::size_t getAttributeCount() const
+        {
+            return record().attribute_count;
+        }
+
+        /**
+         *  @brief  Returns the name and value of the i-th attribute, in
+         *          document order.
+         * */
+        inline std::pair<std::string_view, std::string_view> getAttributeAt(std::size_t i) const
+        {
+            const mapped_attribute_record &a = attribute_record(record().attribute_begin + i);
+            return {text(a.name_offset, a.name_length), text(a.value_offset, a.value_length)};
+        }
+
+        /**
+         *  @brief  Checks if the node has the said attribute.
+         * */
+        inline bool hasAttribute(std::string_view attribute) const
+        {
+            for (std::size_t i = 0; i < getAttributeCount(); ++i)
+                if (getAttributeAt(i).first == attribute)
+                    return true;
+            return false;
+        }
+
+        /**
+         *  @brief  Gets the value of the said attribute, empty if the
+         *          attribute does not exist.
+         * */
+        inline std::string_view getAttribute(std::string_view attribute) const
+        {
+            for (std::size_t i = 0; i < getAttributeCount(); ++i)
+            {
+                auto a = getAttributeAt(i);
+                if (a.first == attribute)
+                    return a.second;
+            }
+            return std::string_view();
+        }
+    };
+
+    /**
+     *  @brief  Tree kept in memory mapped files so that documents larger than
+     *          the memory can be loaded and navigated, the OS pages the data
+     *          in and out on demand. Nodes, attributes and strings each go to
+     *          their own file next to the given path (.nodes, .attrs, .strings),
+     *          all appended to only. Children are linked through first child
+     *          and next sibling UIDs instead of lists.
+     *
+     *          Nodes are added with open/attr/text/close in document order, the
+     *          same calls as DOMtreeBuilder, so fast_parser can fill it directly.
+     * */
+    class DOMmappedTree
+    {
+        friend class DOMmappedNode;
+
+    private:
+        mapped_region nodes;
+        mapped_region attributes;
+        mapped_region strings;
+        std::vector<DOMnodeUID> open_elements;
+        bool failed = false;
+
+        inline mapped_node_record &_record(DOMnodeUID uid)
+        {
+            return reinterpret_cast<mapped_node_record *>(nodes.data())[uid];
+        }
+
+        inline const mapped_node_record &_record(DOMnodeUID uid) const
+        {
+            return reinterpret_cast<const mapped_node_record *>(nodes.data())[uid];
+        }
+
+        inline const mapped_attribute_record &_attribute(std::uint64_t index) const
+        {
+            return reinterpret_cast<const mapped_attribute_record *>(attributes.data())[index];
+        }
+
+        /**
+         *  @brief  Stores a string, returns its offset in the string file.
+         * */
+        inline std::uint64_t store(std::string_view s)
+        {
+            std::size_t offset = strings.append(s.data(), s.size());
+            if (offset == std::size_t(-1))
+            {
+                failed = true;
+                return 0;
+            }
+            return offset;
+        }
+
+        /**
+         *  @brief  Appends a node under the innermost open element.
+         * */
+        DOMnodeUID append(std::string_view text, bool inner_data)
+        {
+            if (failed)
+                return -1;
+            std::uint64_t text_offset = store(text);
+            std::size_t offset = failed ? std::size_t(-1) : nodes.extend(sizeof(mapped_node_record));
+            if (offset == std::size_t(-1))
+            {
+                failed = true;
+                return -1;
+            }
+
+            DOMnodeUID uid = offset / sizeof(mapped_node_record);
+            DOMnodeUID parent = open_elements.empty() ? -1 : open_elements.back();
+            mapped_node_record &r = _record(uid);
+            r.parent = parent;
+            r.first_child = r.last_child = r.next_sibling = -1;
+            r.text_offset = text_offset;
+            r.text_length = text.size();
+            r.attribute_begin = attributes.size() / sizeof(mapped_attribute_record);
+            r.attribute_count = 0;
+            r.inner_data = inner_data;
+
+            if (parent != -1)
+            {
+                mapped_node_record &p = _record(parent);
+                if (p.last_child == -1)
+                    p.first_child = uid;
+                else
+                    _record(p.last_child).next_sibling = uid;
+                p.last_child = uid;
+            }
+            return uid;
+        }
+
+    public:
+        DOMmappedTree() {}
+        DOMmappedTree(const DOMmappedTree &) = delete;
+        DOMmappedTree &operator=(const DOMmappedTree &) = delete;
+
+        /**
+         *  @brief  Creates empty storage files for a new tree.
+         *  @param  path    base path of the storage files
+         *  @return false if the files cannot be created
+         * */
+        bool create(const std::filesystem::path &path)
+        {
+            failed = false;
+            open_elements.clear();
+            std::string base = path.string();
+            return nodes.create(base + ".nodes") &&
+                   attributes.create(base + ".attrs") &&
+                   strings.create(base + ".strings");
+        }
+
+        /**
+         *  @brief  Maps the storage files of a tree built earlier, read only.
+         *  @param  path    base path of the storage files
+         *  @return false if the files cannot be mapped
+         * */
+        bool load(const std::filesystem::path &path)
+        {
+            failed = false;
+            open_elements.clear();
+            std::string base = path.string();
+            return nodes.open(base + ".nodes") &&
+                   attributes.open(base + ".attrs") &&
+                   strings.open(base + ".strings");
+        }
+
+        /**
+         *  @brief  Trims the storage files once the tree is built.
+         *  @return false if the tree could not be stored completely
+         * */
+        bool finish()
+        {
+            nodes.finish();
+            attributes.finish();
+            strings.finish();
+            return !failed;
+        }
+
+        inline DOMmappedTree &open(std::string_view name)
+        {
+            DOMnodeUID uid = append(name, false);
+            open_elements.push_back(uid);
+            return *this;
+        }
+
+        /**
+         *  @brief  Sets an attribute on the innermost open element, a repeated
+         *          name overwrites the earlier value.
+         * */
+        DOMmappedTree &attr(std::string_view attribute, std::string_view value)
+        {
+            DOMnodeUID uid = open_elements.back();
+            if (uid == -1 || failed)
+                return *this;
+
+            mapped_attribute_record a;
+            a.name_offset = store(attribute);
+            a.name_length = attribute.size();
+            a.value_offset = store(value);
+            a.value_length = value.size();
+
+            mapped_node_record &r = _record(uid);
+            for (std::uint32_t i = 0; i < r.attribute_count; ++i)
+            {
+                auto &existing = reinterpret_cast<mapped_attribute_record *>(attributes.data())[r.attribute_begin + i];
+                if (std::string_view(strings.data() + existing.name_offset, existing.name_length) == attribute)
+                {
+                    existing = a;
+                    return *this;
+                }
+            }
+            if (attributes.append(&a, sizeof(a)) == std::size_t(-1))
+                failed = true;
+            else
+                ++_record(uid).attribute_count;
+            return *this;
+        }
+
+        inline DOMmappedTree &text(std::string_view data)
+        {
+            append(data, true);
+            return *this;
+        }
+
+        inline DOMmappedTree &close()
+        {
+            open_elements.pop_back();
+            return *this;
+        }
+
+        /**
+         *  @brief  Returns the number of nodes in the tree.
+         * */
+        inline DOMnodeUID getNodeCount() const
+        {
+            return nodes.size() / sizeof(mapped_node_record);
+        }
+
+        /**
+         *  @brief  Returns a view of the node with given UID.
+         * */
+        inline DOMmappedNode getNode(DOMnodeUID node) const
+        {
+            return DOMmappedNode(this, node);
+        }
+
+        /**
+         *  @brief  Hints the OS about the access pattern to come.
+         *  @param  sequential  true for sequential, false for random access
+         * */
+        void advise(bool sequential)
+        {
+            nodes.advise(sequential);
+            attributes.advise(sequential);
+            strings.advise(sequential);
+        }
+    };
+
+    inline const mapped_node_record &DOMmappedNode::record() const
+    {
+        return tree->_record(uid);
+    }
+
+    inline std::string_view DOMmappedNode::text(std::uint64_t offset, std::uint32_t length) const
+    {
+        return std::string_view(tree->strings.data() + offset, length);
+    }
+
+    inline const mapped_attribute_record &DOMmappedNode::attribute_record(std::uint64_t index) const
+    {
+        return tree->_attribute(index);
+    }
+
+    inline DOMmappedNode::children_range::iterator &DOMmappedNode::children_range::iterator::operator++()
+    {
+        uid = tree->_record(uid).next_sibling;
+        return *this;
+    }
+} // namespace dom_parser
+
+#endif
+#endif
@@ -0,0 +1,104 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_MARKUP
+#define DOM_PARSER_DOM_MARKUP
+
+#include <cstring>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Finds the first occurrence of a marker such as "-->" or "]]>".
+     *          With SSE2, 16 positions are tested at a time by comparing the
+     *          first and the last byte of the marker, the remaining bytes
+     *          only where both match. Otherwise memchr finds the candidates.
+     *  @return start of the marker, nullptr if not found
+     * */
+    inline const char *find_marker(const char *p, const char *end, std::string_view marker)
+    {
+        const std::size_t n = marker.size();
+#ifdef __SSE2__
+        const __m128i first = _mm_set1_epi8(marker.front());
+        const __m128i last = _mm_set1_epi8(marker.back());
+        for (; end - p >= static_cast<std::ptrdiff_t>(n + 15); p += 16)
+        {
+            __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + n - 1));
+            unsigned mask = _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+            while (mask != 0)
+            {
+                unsigned k = __builtin_ctz(mask);
+                if (std::memcmp(p + k, marker.data(), n) == 0)
+                    return p + k;
+                mask &= mask - 1;
+            }
+        }
+#endif
+        while (end - p >= static_cast<std::ptrdiff_t>(n))
+        {
+            p = static_cast<const char *>(std::memchr(p, marker.front(), end - p - n + 1));
+            if (p == nullptr)
+                return nullptr;
+            if (std::memcmp(p, marker.data(), n) == 0)
+                return p;
+            ++p;
+        }
+        return nullptr;
+    }
+
+    /**
+     *  @brief  Finds the end of a declaration such as <!DOCTYPE ...>, which
+     *          may hold quoted strings and an internal subset in brackets.
+     *  @param  p   position after "<!"
+     *  @return position after the closing '>', nullptr if data ends first
+     * */
+    inline const char *declaration_end(const char *p, const char *end)
+    {
+        std::size_t depth = 0; // open brackets
+        for (; p < end; ++p)
+        {
+            switch (*p)
+            {
+            case '\"':
+            case '\'':
+                p = static_cast<const char *>(std::memchr(p + 1, *p, end - p - 1));
+                if (p == nullptr)
+                    return nullptr;
+                break;
+            case '[':
+                ++depth;
+                break;
+            case ']':
+                if (depth != 0)
+                    --depth;
+                break;
+            case '>':
+                if (depth == 0)
+                    return p + 1;
+                break;
+            }
+        }
+        return nullptr;
+    }
+} // namespace dom_parser
+
+#endif
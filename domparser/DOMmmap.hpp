@@ -0,0 +1,291 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_MMAP
+#define DOM_PARSER_DOM_MMAP
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DOM_PARSER_HAS_MMAP
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Read only memory mapping of a whole file. Pages are read by
+     *          the OS when they are first touched.
+     * */
+    class mapped_input
+    {
+    private:
+        int fd = -1;
+        char *base = nullptr;
+        std::size_t length = 0;
+
+    public:
+        mapped_input() {}
+        mapped_input(const mapped_input &) = delete;
+        mapped_input &operator=(const mapped_input &) = delete;
+
+        ~mapped_input()
+        {
+            close();
+        }
+
+        /**
+         *  @brief  Maps the file.
+         *  @return false if the file cannot be opened or mapped
+         * */
+        bool open(const std::filesystem::path &path)
+        {
+            close();
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd == -1)
+                return false;
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+                return false;
+            length = info.st_size;
+            if (length == 0)
+                return true;
+            void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                length = 0;
+                return false;
+            }
+            base = static_cast<char *>(mapping);
+            madvise(base, length, MADV_SEQUENTIAL);
+            return true;
+        }
+
+        void close()
+        {
+            if (base != nullptr)
+                munmap(base, length);
+            if (fd != -1)
+                ::close(fd);
+            base = nullptr;
+            fd = -1;
+            length = 0;
+        }
+
+        inline const char *data() const
+        {
+            return base;
+        }
+
+        inline std::size_t size() const
+        {
+            return length;
+        }
+    };
+
+    /**
+     *  @brief  Append only storage kept in a memory mapped file. The file
+     *          starts with a small header holding the number of bytes in use,
+     *          so the storage can be mapped again later. Growing the storage
+     *          may move the mapping, offsets stay valid but pointers do not.
+     * */
+    class mapped_region
+    {
+    private:
+        const static std::size_t header_size = 64;
+
+        int fd = -1;
+        char *base = nullptr;
+        std::size_t capacity = 0; // mapped bytes, header included
+        bool writable = false;
+
+        inline std::uint64_t &used()
+        {
+            return *reinterpret_cast<std::uint64_t *>(base);
+        }
+
+        bool map(std::size_t _capacity)
+        {
+            int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+            void *mapping = mmap(nullptr, _capacity, protection, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED)
+                return false;
+            base = static_cast<char *>(mapping);
+            capacity = _capacity;
+            return true;
+        }
+
+        /**
+         *  @brief  Grows the file and the mapping to hold at least n more bytes.
+         *          The new blocks are allocated before they are mapped, so a
+         *          full disk fails here, keeping the old mapping, instead of
+         *          raising SIGBUS on a later write.
+         * */
+        bool grow(std::size_t n)
+        {
+            std::size_t needed = header_size + used() + n;
+            std::size_t new_capacity = capacity;
+            while (new_capacity < needed)
+                new_capacity *= 2;
+            if (posix_fallocate(fd, capacity, new_capacity - capacity) != 0)
+                return false;
+            char *old_base = base;
+            std::size_t old_capacity = capacity;
+            if (!map(new_capacity))
+                return false;
+            munmap(old_base, old_capacity);
+            return true;
+        }
+
+    public:
+        mapped_region() {}
+        mapped_region(const mapped_region &) = delete;
+        mapped_region &operator=(const mapped_region &) = delete;
+
+        ~mapped_region()
+        {
+            close();
+        }
+
+        /**
+         *  @brief  Creates the file, replacing an existing one, and maps it
+         *          for appending. Fails if the blocks of the initial capacity
+         *          cannot be allocated.
+         *  @param  path                path of the backing file
+         *  @param  initial_capacity    bytes to start with, grown by doubling
+         * */
+        bool create(const std::filesystem::path &path, std::size_t initial_capacity = 1 << 20)
+        {
+            close();
+            writable = true;
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd == -1)
+                return false;
+            std::size_t _capacity = header_size + initial_capacity;
+            if (posix_fallocate(fd, 0, _capacity) != 0 || !map(_capacity))
+                return false;
+            used() = 0;
+            return true;
+        }
+
+        /**
+         *  @brief  Maps a file written earlier by create() and finish(), read only.
+         * */
+        bool open(const std::filesystem::path &path)
+        {
+            close();
+            writable = false;
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd == -1)
+                return false;
+            struct stat info;
+            if (fstat(fd, &info) != 0 || std::size_t(info.st_size) < header_size || !map(info.st_size))
+                return false;
+            return header_size + used() <= capacity;
+        }
+
+        /**
+         *  @brief  Trims the file to the bytes in use.
+         * */
+        void finish()
+        {
+            if (!writable || base == nullptr)
+                return;
+            std::size_t _capacity = header_size + used();
+            munmap(base, capacity);
+            base = nullptr;
+            if (ftruncate(fd, _capacity) == 0)
+                map(_capacity);
+        }
+
+        void close()
+        {
+            if (base != nullptr)
+                munmap(base, capacity);
+            if (fd != -1)
+                ::close(fd);
+            base = nullptr;
+            fd = -1;
+            capacity = 0;
+        }
+
+        /**
+         *  @brief  Reserves n bytes at the end of the storage.
+         *  @return offset of the reserved bytes, -1 if the storage is not
+         *          mapped or cannot grow
+         * */
+        std::size_t extend(std::size_t n)
+        {
+            if (base == nullptr || !writable)
+                return std::size_t(-1);
+            if (header_size + used() + n > capacity && !grow(n))
+                return std::size_t(-1);
+            std::size_t offset = used();
+            used() += n;
+            return offset;
+        }
+
+        /**
+         *  @brief  Appends the bytes to the storage.
+         *  @return offset of the bytes, -1 if the storage is not mapped or
+         *          cannot grow
+         * */
+        inline std::size_t append(const void *bytes, std::size_t n)
+        {
+            std::size_t offset = extend(n);
+            if (offset != std::size_t(-1))
+                std::memcpy(data() + offset, bytes, n);
+            return offset;
+        }
+
+        /**
+         *  @brief  Hints the OS about the access pattern to come.
+         *  @param  sequential  true for sequential, false for random access
+         * */
+        void advise(bool sequential)
+        {
+            if (base != nullptr)
+                madvise(base, capacity, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        }
+
+        inline char *data()
+        {
+            return base + header_size;
+        }
+
+        inline const char *data() const
+        {
+            return base + header_size;
+        }
+
+        inline std::size_t size() const
+        {
+            return base != nullptr ? *reinterpret_cast<const std::uint64_t *>(base) : 0;
+        }
+
+        inline bool is_open() const
+        {
+            return base != nullptr;
+        }
+    };
+} // namespace dom_parser
+
+#endif
+#endif
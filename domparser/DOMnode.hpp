@@ -15,28 +15,88 @@
 #ifndef DOM_PARSER_DOM_NODE
 #define DOM_PARSER_DOM_NODE
 
+#include <functional>
 #include <list>
 #include <map>
 #include <string>
+#include <string_view>
 
 #include "DOMnodeUID.hpp"
+#include "DOMvalue.hpp"
 
 namespace dom_parser
 {
+    class DOMtree;
+    class DOMtreeBuilder;
+    class DOMfragmentBuilder;
+
+    /// @brief   Attributes of a node, looked up by std::string_view as well.
+    ///          Use this type for the result of DOMnode::getAllAttributes.
+    typedef std::map<std::string, std::string, std::less<>> DOMattributes;
+
     /// @brief   Node in the DOM tree.
     class DOMnode
     {
+        friend class DOMtree;
+        friend class DOMtreeBuilder;
+        friend class DOMfragmentBuilder;
+
     private:
         DOMnodeUID uid;
-        DOMnodeUID parent;
+        DOMnodeUID parent; // next vacant UID while the node is a tombstone
         std::list<DOMnodeUID> children;
-        std::map<std::string, std::string> tagAttributes;
+        DOMattributes tagAttributes;
         std::string tagName;
 
         // if innerData node
         bool innerDataNode = false;
         std::string innerData;
 
+        // set when the node is deleted, the slot is then kept by the tree
+        // for reuse instead of being freed
+        bool tombstone = false;
+
+        /**
+         * @brief   Turns the node into a tombstone, releasing its children and
+         *          attributes but keeping the string buffers for reuse.
+         * @param   next_vacant     UID of the next vacant slot in the tree
+         * */
+        inline void _bury(DOMnodeUID next_vacant)
+        {
+            children.clear();
+            tagAttributes.clear();
+            tagName.clear();
+            innerData.clear();
+            innerDataNode = false;
+            tombstone = true;
+            uid = -1;
+            parent = next_vacant;
+        }
+
+        /**
+         * @brief   Parses the said attribute, see getInt.
+         * */
+        template <typename T>
+        inline int _getValue(std::string_view attribute, T &value) const
+        {
+            auto i = tagAttributes.find(attribute);
+            if (i == tagAttributes.end())
+                return -1;
+            return parse_value(i->second, value) ? 0 : -2;
+        }
+
+        /**
+         * @brief   Brings a tombstone back to life as an empty node.
+         * @param   _uid        new UID of the node
+         * @param   _parent     UID of the parent
+         * */
+        inline void _revive(DOMnodeUID _uid, DOMnodeUID _parent)
+        {
+            tombstone = false;
+            uid = _uid;
+            parent = _parent;
+        }
+
     public:
         /**
          * @brief   Constructor for DOMnode
@@ -56,9 +116,9 @@ namespace dom_parser
             : uid(uid), parent(parent), innerData(innerData), innerDataNode(true){};
 
         /**
-         * @brief   Returns the tagName of the node.
+         * @brief   Returns reference to the tagName of the node.
          */
-        inline std::string getTagName()
+        inline const std::string &getTagName() const
         {
             return tagName;
         }
@@ -66,7 +126,7 @@ namespace dom_parser
         /**
          * @brief   Returns the UID of the node.
          */
-        inline DOMnodeUID getUID()
+        inline DOMnodeUID getUID() const
         {
             return uid;
         }
@@ -74,14 +134,41 @@ namespace dom_parser
         /**
          * @brief   Sets a new value to existing attribute or
          *          adds new attribute with the given value.
+         *          An existing value is overwritten in place.
+         * @param   attribute   Name of the attribute
+         * @param   value       Data of the attribute
+         */
+        inline void setAttribute(std::string_view attribute, std::string_view value)
+        {
+            if (innerDataNode)
+                return;
+            auto i = tagAttributes.find(attribute);
+            if (i != tagAttributes.end())
+                i->second.assign(value.data(), value.size());
+            else
+                tagAttributes.emplace(std::string(attribute), std::string(value));
+        }
+
+        /**
+         * @brief   Sets a new value to existing attribute or
+         *          adds new attribute with the given value,
+         *          moving the strings into the node.
          * @param   attribute   Name of the attribute
          * @param   value       Data of the attribute
          */
-        inline void setAttribute(std::string attribute, std::string value)
+        inline void setAttribute(std::string &&attribute, std::string &&value)
         {
             if (innerDataNode)
                 return;
-            tagAttributes[attribute] = value;
+            tagAttributes.insert_or_assign(std::move(attribute), std::move(value));
+        }
+
+        /**
+         * @brief   Overload for string literals.
+         */
+        inline void setAttribute(const char *attribute, const char *value)
+        {
+            setAttribute(std::string_view(attribute), std::string_view(value));
         }
 
         /**
@@ -91,36 +178,119 @@ namespace dom_parser
          * @param   attributes  attributes to be set
          */
         inline void setAttributes(const std::map<std::string, std::string> &attributes)
+        {
+            tagAttributes = DOMattributes(attributes.begin(), attributes.end());
+        }
+
+        /**
+         * @brief   Sets attributes from the DOMattributes provided
+         *          which has pairs like {attribute, value}.
+         *          Previous attributes will be cleared.
+         * @param   attributes  attributes to be set
+         */
+        inline void setAttributes(const DOMattributes &attributes)
         {
             tagAttributes = attributes;
         }
 
         /**
-         * @brief   Sets attributes from the rvalue std::map provided
+         * @brief   Sets attributes from the rvalue DOMattributes provided
          *          which has pairs like {attribute, value}.
          *          Previous attributes will be cleared.
          * @param   attributes  attributes to be set
          */
-        inline void setAttributes(std::map<std::string, std::string> &&attributes)
+        inline void setAttributes(DOMattributes &&attributes)
         {
             tagAttributes.swap(attributes);
         }
 
+        /**
+         * @brief   Removes the said attribute if it exists.
+         * @param   attribute   Name of the attribute
+         * @return  true if the attribute existed
+         */
+        inline bool removeAttribute(std::string_view attribute)
+        {
+            auto i = tagAttributes.find(attribute);
+            if (i == tagAttributes.end())
+                return false;
+            tagAttributes.erase(i);
+            return true;
+        }
+
         /**
          * @brief   Gets the value of the said attribute. Returns
          *          empty string if the attribute does not exist.
+         *          Copies the value, see findAttribute.
+         * @param   attribute   Name of the attribute
+         */
+        inline std::string getAttribute(std::string_view attribute) const
+        {
+            auto i = tagAttributes.find(attribute);
+            return (i == tagAttributes.end()) ? std::string() : i->second;
+        }
+
+        /**
+         * @brief   Returns pointer to the value of the said attribute,
+         *          nullptr if the attribute does not exist. Nothing is copied.
          * @param   attribute   Name of the attribute
          */
-        inline std::string getAttribute(std::string attribute)
+        inline const std::string *findAttribute(std::string_view attribute) const
         {
-            return tagAttributes.find(attribute)->second;
+            auto i = tagAttributes.find(attribute);
+            return (i == tagAttributes.end()) ? nullptr : &(i->second);
+        }
+
+        /**
+         * @brief   Reads the said attribute as an integer, without copying it.
+         * @param   attribute   Name of the attribute
+         * @param   value       set to the integer, untouched on failure
+         * @return  0 if read, -1 if the attribute does not exist,
+         *          -2 if its value is not an integer
+         */
+        inline int getInt(std::string_view attribute, long long &value) const
+        {
+            return _getValue(attribute, value);
+        }
+
+        /**
+         * @brief   Reads the said attribute as a floating point number.
+         * @param   attribute   Name of the attribute
+         * @param   value       set to the number, untouched on failure
+         * @return  0 if read, -1 if the attribute does not exist,
+         *          -2 if its value is not a number
+         */
+        inline int getDouble(std::string_view attribute, double &value) const
+        {
+            return _getValue(attribute, value);
+        }
+
+        /**
+         * @brief   Reads the said attribute as a boolean: true, false, 1 or 0.
+         * @param   attribute   Name of the attribute
+         * @param   value       set to the boolean, untouched on failure
+         * @return  0 if read, -1 if the attribute does not exist,
+         *          -2 if its value is not a boolean
+         */
+        inline int getBool(std::string_view attribute, bool &value) const
+        {
+            return _getValue(attribute, value);
+        }
+
+        /**
+         * @brief   Checks if the node has the said attribute.
+         * @param   attribute   Name of the attribute
+         */
+        inline bool hasAttribute(std::string_view attribute) const
+        {
+            return tagAttributes.find(attribute) != tagAttributes.end();
         }
 
         /**
          * @brief   Returns reference to the the ordered map of all the attributes
          *          with their values.
          * */
-        inline const std::map<std::string, std::string> &getAllAttributes()
+        inline const DOMattributes &getAllAttributes() const
         {
             return tagAttributes;
         }
@@ -128,7 +298,7 @@ namespace dom_parser
         /**
          * @brief   Returns reference to the list of children of the node.
          */
-        inline const std::list<DOMnodeUID> &getChildrenUID()
+        inline const std::list<DOMnodeUID> &getChildrenUID() const
         {
             return children;
         }
@@ -144,6 +314,26 @@ namespace dom_parser
             children.push_back(child);
         }
 
+        /**
+         * @brief   Adds a new child right after one of the existing children.
+         * @param   child    Child node.
+         * @param   after    Existing child to follow, -1 to add as first child.
+         */
+        void addChild(DOMnodeUID child, DOMnodeUID after)
+        {
+            if (innerDataNode)
+                return;
+            auto i = children.begin();
+            if (after != -1)
+            {
+                while (i != children.end() && *i != after)
+                    ++i;
+                if (i != children.end())
+                    ++i;
+            }
+            children.insert(i, child);
+        }
+
         /**
          * @brief   Removes the child node with the given UID.
          * @param   uid     UID of the child node to remove.
@@ -158,7 +348,7 @@ namespace dom_parser
         /**
          * @brief   Returns the parent node UID.
          */
-        inline DOMnodeUID getParent()
+        inline DOMnodeUID getParent() const
         {
             return parent;
         }
@@ -175,16 +365,24 @@ namespace dom_parser
         /**
          * @brief   Checks if node is inner-data node
          * */
-        inline bool isInnerDataNode()
+        inline bool isInnerDataNode() const
         {
             return innerDataNode;
         }
 
+        /**
+         * @brief   Checks if the node has been deleted from its tree.
+         * */
+        inline bool isDeleted() const
+        {
+            return tombstone;
+        }
+
         /**
          * @brief   Returns reference to inner-data if the node stores inner data.
          *          Returns empty string if node does not store inner-data.
          * */
-        inline const std::string &getInnerData()
+        inline const std::string &getInnerData() const
         {
             return innerData;
         }
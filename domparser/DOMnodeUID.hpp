@@ -15,9 +15,21 @@
 #ifndef DOM_PARSER_DOM_NODE_UID
 #define DOM_PARSER_DOM_NODE_UID
 
+#include <cstdint>
+
+/**
+ * Define DOM_PARSER_64BIT_UID before including the library to use 64-bit
+ * node UIDs, for documents with more than 2^31 - 1 nodes. The default
+ * 32-bit UIDs keep child lists and tree indices compact. UIDs are signed
+ * in both cases, -1 stands for no node.
+ * */
 namespace dom_parser
 {
-    typedef int DOMnodeUID;
+#ifdef DOM_PARSER_64BIT_UID
+    typedef std::int64_t DOMnodeUID;
+#else
+    typedef std::int32_t DOMnodeUID;
+#endif
 } // namespace dom_parser
 
 #endif
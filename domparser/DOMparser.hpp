@@ -15,6 +15,8 @@
 #ifndef DOM_PARSER_DOM_PARSER
 #define DOM_PARSER_DOM_PARSER
 
+#include <iterator>
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
@@ -27,16 +29,48 @@
 #include <iostream>
 #endif
 
+#include "DOMentities.hpp"
+#include "DOMFastParser.hpp"
 #include "DOMLexer.hpp"
+#include "DOMschema.hpp"
+#include "DOMstreamQuery.hpp"
 #include "DOMtree.hpp"
+#include "DOMtreeBuilder.hpp"
+#include "DOMwriter.hpp"
 
 namespace dom_parser
 {
+    /**
+     * @brief   Problem found and recovered from by DOMparser::loadTree_recover.
+     */
+    struct parse_diagnostic
+    {
+        std::size_t offset; // byte offset in the UTF-8 input
+        std::size_t line;   // line number, counted from 1
+        std::string message;
+    };
+
     class DOMparser
     {
     private:
         DOMtree tree;
 
+        // state kept between loads so that their storage is reused
+        std::unique_ptr<lexer> reusable_lexer;
+        std::stack<DOMnodeUID, std::vector<DOMnodeUID>> element_stack;
+        fast_parser scanner;
+        bool reuse_storage = false; // set by reset(), the tree storage is reused by the next load
+
+        // incremental mode, see loadTree_incremental
+        bool incremental = false;
+        std::string source_text;              // UTF-8 text the tree was parsed from
+        std::vector<node_span> source_spans;  // byte offsets of the nodes in source_text, by UID
+        DOMnodeUID stale_element = -1;        // element whose subtree failed to re-parse
+        const static DOMnodeUID stale_document = -2; // stale_element when the whole text failed
+        std::vector<DOMnodeUID> affected_nodes;
+        std::vector<DOMnodeUID> graft_remap; // fragment UID to tree UID
+        std::vector<parse_diagnostic> diagnostics; // found by the last loadTree_recover
+
         /**
          * @brief   deprecated, loads tree from the data
          */
@@ -48,7 +82,7 @@ namespace dom_parser
             // add the root
             {
                 std::string tag_name;
-                std::map<std::string, std::string> attr;
+                DOMattributes attr;
                 int res;
                 // ignore white-space
                 // for (; i != data.end(); ++i)
@@ -80,7 +114,7 @@ namespace dom_parser
             for (; i != data.end(); ++i)
             {
                 std::string tag_name, inner_data;
-                std::map<std::string, std::string> attr;
+                DOMattributes attr;
                 int res;
                 if (*i == '<')
                 {
@@ -121,6 +155,7 @@ namespace dom_parser
 
                     if (inner_data != " " && inner_data != "\n" && inner_data != "\r\n")
                     {
+                        decode_entities(inner_data);
                         tree.addInnerDataNode(element_stack.top(), inner_data);
                         // std::cout << "\n\tdebug: inner_data=\"" << inner_data << "\"\n";
                     }
@@ -133,13 +168,170 @@ namespace dom_parser
             return 0;
         }
 
+        /**
+         * @brief   Sets the root of the tree being loaded, reusing the storage
+         *          of the previous tree after reset().
+         * @param   tag_name    name of the root
+         */
+        inline void _set_root(std::string &&tag_name)
+        {
+            if (reuse_storage)
+                tree.clear(std::move(tag_name));
+            else
+            {
+                DOMtree _tree(tag_name);
+                tree = _tree;
+            }
+            reuse_storage = false;
+            incremental = false;
+        }
+
+        /**
+         * @brief   Finds the deepest element whose content holds the byte range,
+         *          not descending into the stale element.
+         * @return  UID of the element, -1 if the range is not inside the root content
+         */
+        DOMnodeUID _enclosing_element(std::size_t from, std::size_t to)
+        {
+            auto inside = [&](DOMnodeUID uid) {
+                const node_span &span = source_spans[uid];
+                return span.content_begin <= from && to <= span.content_end;
+            };
+            if (!inside(0))
+                return -1;
+
+            DOMnodeUID element = 0;
+            while (element != stale_element)
+            {
+                DOMnodeUID next = -1;
+                for (DOMnodeUID child : tree.getNode(element).getChildrenUID())
+                {
+                    if (source_spans[child].begin > to)
+                        break;
+                    if (!tree.getNode(child).isInnerDataNode() && inside(child))
+                    {
+                        next = child;
+                        break;
+                    }
+                }
+                if (next == -1)
+                    break;
+                element = next;
+            }
+            return element;
+        }
+
+        /**
+         * @brief   Moves the offsets at or past the end of an edit by the change
+         *          in length, along with the text after the edit.
+         */
+        void _shift_spans(std::size_t edit_end, std::ptrdiff_t delta)
+        {
+            if (delta == 0)
+                return;
+            for (node_span &span : source_spans)
+            {
+                if (span.begin >= edit_end)
+                    span.begin += delta;
+                if (span.content_begin > edit_end) // text inserted at the start of the content stays inside
+                    span.content_begin += delta;
+                if (span.content_end >= edit_end)
+                    span.content_end += delta;
+                if (span.end >= edit_end)
+                    span.end += delta;
+            }
+        }
+
+        /**
+         * @brief   Moves the children of the root of a parsed fragment under
+         *          an element of the tree, together with their spans.
+         * @param   parent  element receiving the nodes
+         * @param   after   child of the element to follow, -1 for the first place
+         * @param   base    offset of the fragment root in source_text
+         * @return  false if the tree ran out of UIDs
+         */
+        bool _graft(DOMtree &&fragment, const std::vector<node_span> &spans,
+                    DOMnodeUID parent, DOMnodeUID after, std::size_t base)
+        {
+            // the top level children are copied last to first, each to the
+            // front of the nodes following after
+            graft_remap.assign(spans.size(), -1);
+            const auto &top = fragment.getNode(0).getChildrenUID();
+            for (auto child = top.rbegin(); child != top.rend(); ++child)
+                if (tree.graftSubtree(std::move(fragment), *child, parent, after, &graft_remap) == -1)
+                    return false;
+
+            for (std::size_t from = 0; from < graft_remap.size(); from++)
+            {
+                DOMnodeUID uid = graft_remap[from];
+                if (uid == -1)
+                    continue;
+                if (source_spans.size() <= std::size_t(uid))
+                    source_spans.resize(uid + 1);
+                const node_span &span = spans[from];
+                source_spans[uid] = {span.begin + base, span.content_begin + base,
+                                     span.content_end + base, span.end + base};
+            }
+            return true;
+        }
+
+        /**
+         * @brief   Parses a range of the content of an element again and
+         *          replaces affected_nodes, the children it held, by the result.
+         * @param   element     element holding the range
+         * @param   from        offset of the range in source_text
+         * @param   to          end of the range
+         * @param   after       child of the element before the range, -1 if none
+         * @return  -2 if the range does not parse, the tree is then unchanged
+         */
+        int _reparse_range(DOMnodeUID element, std::size_t from, std::size_t to, DOMnodeUID after)
+        {
+            std::string fragment = "<f>";
+            fragment.append(source_text, from, to - from);
+            fragment += "</f>";
+            DOMtree parsed;
+            std::vector<node_span> spans;
+            if (scanner.parse(std::unique_ptr<input_source>(new memory_source(std::move(fragment))), parsed, spans) != 0)
+                return -2;
+
+            for (DOMnodeUID child : affected_nodes)
+                tree.deleteSubtree(child);
+            if (stale_element != -1 && (stale_element == element || tree.getNode(stale_element).isDeleted()))
+                stale_element = -1;
+            return _graft(std::move(parsed), spans, element, after, from - 3) ? 0 : -2;
+        }
+
+        /**
+         * @brief   Re-parses the whole source text after an edit that is not
+         *          inside the content of the root.
+         */
+        int _reparse_all()
+        {
+            std::vector<node_span> spans;
+            DOMtree parsed;
+            if (scanner.parse(std::unique_ptr<input_source>(new memory_source(source_text)), parsed, spans) != 0)
+            {
+                stale_element = stale_document;
+                return -2;
+            }
+            tree = std::move(parsed);
+            source_spans.swap(spans);
+            stale_element = -1;
+            return 0;
+        }
+
         /**
          * @brief   loads tree from the data
          */
-        int _parser(std::filesystem::path file)
+        int _parser(std::unique_ptr<input_source> &&source)
         {
-            lexer _lexer(file);
-            std::stack<DOMnodeUID> element_stack;
+            if (reusable_lexer)
+                reusable_lexer->reset(std::move(source));
+            else
+                reusable_lexer.reset(new lexer(std::move(source)));
+            lexer &_lexer = *reusable_lexer;
+            while (!element_stack.empty())
+                element_stack.pop();
             auto _T = _lexer.next();
 
             if (_T->token != lexer_token_values::T_OPENTAG)
@@ -149,14 +341,13 @@ namespace dom_parser
             {
                 DOMnodeUID uid = 0; // for root
                 std::string tag_name;
-                std::map<std::string, std::string> attributes;
+                DOMattributes attributes;
 
                 int res = _data_scan_tag(_lexer, tag_name, attributes);
                 if (res != 1)
                     return -2;
 
-                DOMtree _tree(tag_name);
-                tree = _tree;
+                _set_root(std::move(tag_name));
                 element_stack.push(uid);
                 tree.getNode(uid).setAttributes(std::move(attributes));
             }
@@ -165,7 +356,7 @@ namespace dom_parser
             while (_T->token != lexer_token_values::T_FILEEND)
             {
                 std::string tag_name;
-                std::map<std::string, std::string> attributes;
+                DOMattributes attributes;
                 DOMnodeUID uid;
 
                 if (_T->token == lexer_token_values::T_OPENTAG) // read tag
@@ -218,23 +409,222 @@ namespace dom_parser
 
                     _T = _lexer.next();
                 }
-                else // read innerData
+                else // read innerData, with CDATA sections in it
                 {
 #ifdef DOM_PARSER_DEBUG_MODE
                     std::cout << "\n\tdebug: PARSER: innerData"
                               << "\n";
 #endif
                     std::string innerData = "";
-                    while (_T->token != lexer_token_values::T_OPENTAG)
+                    while (_T->token != lexer_token_values::T_OPENTAG &&
+                           _T->token != lexer_token_values::T_FILEEND)
                     {
-                        innerData += _T->value + " ";
+                        _append_token(innerData, _T);
                         _T = _lexer.next();
                     }
-                    innerData.erase(innerData.length() - 1, 1); // trim the last space
-                    tree.addInnerDataNode(element_stack.top(), innerData);
+                    if (element_stack.empty())
+                        return -2;
+                    if (!innerData.empty())
+                        tree.addInnerDataNode(element_stack.top(), innerData);
+                }
+            }
+
+            if (_lexer.encoding_error() || _lexer.markup_error())
+                return -2;
+
+            return 0;
+        }
+
+        /**
+         * @brief   Appends the value of a token to text, with one space if
+         *          white space separates it from the token before. CDATA
+         *          sections are appended as they are.
+         */
+        static inline void _append_token(std::string &text, const lexer_token *token)
+        {
+            if (token->space_before && !text.empty())
+                text += ' ';
+            text += token->value;
+        }
+
+        /**
+         * @brief   Records a problem found by _parser_recover.
+         */
+        inline void _diagnose(std::size_t offset, std::size_t line, std::string &&message)
+        {
+            diagnostics.push_back({offset, line, std::move(message)});
+        }
+
+        /**
+         * @brief   Loads tree from the data like _parser, but goes on after
+         *          syntax errors. A malformed tag is dropped and scanning
+         *          resumes at the next tag, a closing tag closes the open
+         *          elements above the matching one and stray closing tags are
+         *          ignored. Nodes after the root are added to the root.
+         */
+        int _parser_recover(std::unique_ptr<input_source> &&source)
+        {
+            diagnostics.clear();
+            if (reusable_lexer)
+                reusable_lexer->reset(std::move(source));
+            else
+                reusable_lexer.reset(new lexer(std::move(source)));
+            lexer &_lexer = *reusable_lexer;
+            while (!element_stack.empty())
+                element_stack.pop();
+            bool has_root = false;
+            auto _T = _lexer.next();
+
+            while (_T->token != lexer_token_values::T_FILEEND)
+            {
+                std::size_t offset = _T->offset, line = _T->line;
+                if (_T->token == lexer_token_values::T_OPENTAG) // read tag
+                {
+                    std::string tag_name;
+                    DOMattributes attributes;
+                    int res = _data_scan_tag(_lexer, tag_name, attributes);
+                    if (res == 0) // resynchronize at the next tag
+                    {
+                        _diagnose(offset, line, "malformed tag");
+                        _T = _lexer.current();
+                        while (_T->token != lexer_token_values::T_OPENTAG &&
+                               _T->token != lexer_token_values::T_FILEEND)
+                            _T = _lexer.next();
+                        continue;
+                    }
+
+                    if (res == -1) // closing tag
+                    {
+                        // the open elements are the ancestors of the innermost one
+                        std::size_t depth = 0;
+                        DOMnodeUID uid = element_stack.empty() ? -1 : element_stack.top();
+                        for (; uid != -1 && tree.getNode(uid).getTagName() != tag_name; ++depth)
+                            uid = tree.getNode(uid).getParent();
+                        if (uid == -1)
+                            _diagnose(offset, line, "stray closing tag </" + tag_name + ">, ignored");
+                        else
+                        {
+                            for (; depth != 0; --depth, element_stack.pop())
+                                _diagnose(offset, line, "element <" + tree.getNode(element_stack.top()).getTagName() +
+                                                            "> closed by </" + tag_name + ">");
+                            element_stack.pop();
+                        }
+                    }
+                    else if (!has_root)
+                    {
+                        _set_root(std::move(tag_name));
+                        tree.getNode(0).setAttributes(std::move(attributes));
+                        if (res == 1)
+                            element_stack.push(0);
+                        has_root = true;
+                    }
+                    else
+                    {
+                        if (element_stack.empty())
+                            _diagnose(offset, line, "element <" + tag_name + "> after the root, added to the root");
+                        DOMnodeUID uid = tree.addNode(element_stack.empty() ? 0 : element_stack.top(), tag_name);
+                        tree.getNode(uid).setAttributes(std::move(attributes));
+                        if (res == 1)
+                            element_stack.push(uid);
+                    }
+                    _T = _lexer.next();
+                    continue;
+                }
+
+                std::string innerData; // with CDATA sections in it
+                while (_T->token != lexer_token_values::T_OPENTAG &&
+                       _T->token != lexer_token_values::T_FILEEND)
+                {
+                    _append_token(innerData, _T);
+                    _T = _lexer.next();
+                }
+                if (innerData.empty())
+                    continue;
+                if (!has_root)
+                    _diagnose(offset, line, "text before the root, ignored");
+                else
+                {
+                    if (element_stack.empty())
+                        _diagnose(offset, line, "text after the root, added to the root");
+                    tree.addInnerDataNode(element_stack.empty() ? 0 : element_stack.top(), innerData);
                 }
             }
 
+            if (_lexer.encoding_error())
+                _diagnose(_lexer.encoding_error_offset(), _T->line, "invalid encoding, input ends here");
+            if (_lexer.markup_error())
+                _diagnose(_T->offset, _T->line, "comment, processing instruction or CDATA section not closed");
+            for (; !element_stack.empty(); element_stack.pop())
+                _diagnose(_T->offset, _T->line,
+                          "element <" + tree.getNode(element_stack.top()).getTagName() + "> not closed");
+            if (!has_root)
+            {
+                _diagnose(_T->offset, _T->line, "no root element");
+                return -2;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief   Runs the tokens of the file through the matcher instead of
+         *          building a tree. Mirrors _parser with the element stack
+         *          replaced by the matcher's automaton.
+         */
+        int _run_queries(std::filesystem::path file, stream_matcher &matcher)
+        {
+            lexer _lexer(file);
+            std::size_t depth = 0;
+            matcher.reset();
+
+            auto _T = _lexer.next();
+            if (_T->token != lexer_token_values::T_OPENTAG)
+                return -2; // root node required, error
+
+            do
+            {
+                std::string tag_name;
+                DOMattributes attributes;
+
+                if (_T->token == lexer_token_values::T_OPENTAG) // read tag
+                {
+                    switch (_data_scan_tag(_lexer, tag_name, attributes))
+                    {
+                    case 0: // fail
+                        return -2;
+                    case -1: // closing tag
+                        if (depth == 0)
+                            return -2;
+                        matcher.end_element();
+                        --depth;
+                        break;
+                    case 1: // success
+                        matcher.start_element(tag_name, attributes);
+                        ++depth;
+                        break;
+                    case -2: // self closing tag
+                        matcher.start_element(tag_name, attributes);
+                        matcher.end_element();
+                        break;
+                    }
+                    _T = _lexer.next();
+                }
+                else // read innerData, with CDATA sections in it
+                {
+                    std::string innerData = "";
+                    while (_T->token != lexer_token_values::T_OPENTAG &&
+                           _T->token != lexer_token_values::T_FILEEND)
+                    {
+                        _append_token(innerData, _T);
+                        _T = _lexer.next();
+                    }
+                    if (!innerData.empty())
+                        matcher.text_data(innerData);
+                }
+            } while (depth != 0 && _T->token != lexer_token_values::T_FILEEND);
+
+            if (_lexer.encoding_error() || _lexer.markup_error() || depth != 0)
+                return -2;
+
             return 0;
         }
 
@@ -246,7 +636,7 @@ namespace dom_parser
          *          -2  self closing tag
          * */
         [[deprecated]] int _data_scan_tag(std::string::const_iterator &i, const std::string::const_iterator &end,
-                                          std::string &tag, std::map<std::string, std::string> &attributes)
+                                          std::string &tag, DOMattributes &attributes)
         {
             if (*i != '<')
                 return 0;
@@ -314,6 +704,7 @@ namespace dom_parser
                 }
                 ++i;
 
+                decode_entities(value);
                 attributes[attribute] = value;
             }
             return 1;
@@ -328,7 +719,7 @@ namespace dom_parser
          * */
         int _data_scan_tag(lexer &_lexer,
                            std::string &tag_name,
-                           std::map<std::string, std::string> &attributes)
+                           DOMattributes &attributes)
         {
             auto _T = _lexer.next();
             // everytime we use lexer::next() we will check for file-end token
@@ -343,6 +734,7 @@ namespace dom_parser
                 _T = _lexer.next();
                 if (_T->token != lexer_token_values::T_IDNTIFR)
                     return 0;
+                tag_name = _T->value;
                 _T = _lexer.next();
                 if (_T->token != lexer_token_values::T_CLOSTAG)
                     return 0;
@@ -400,11 +792,10 @@ namespace dom_parser
                         {
                             if (_T->token == lexer_token_values::T_FILEEND)
                                 return 0;
-                            value += _T->value + " ";
+                            _append_token(value, _T);
 
                             _T = _lexer.next();
                         }
-                        value.erase(value.length() - 1, 1); // trim the last space
                         attributes[attribute] = value;
                     }
                     else
@@ -431,59 +822,18 @@ namespace dom_parser
             return 0;
         }
 
-        /**
-         * @brief   Helper function, generates output for the tree.
-         * @param   _node       Initial node
-         * @param   indent      Indentation string
-         * @param   indentation Current indentation at the node
-         * @param   _newline    Char to be used as newline char
-         * */
-        std::string _process_output_for_node(DOMnodeUID _node, const std::string &indent,
-                                             std::string indentation, std::string _newline)
-        {
-            auto node = tree.getNode(_node);
-            std::string s;
-
-            // set indentation
-            s += indentation;
-
-            // check if node is innerData node
-            if (node.isInnerDataNode())
-            {
-                s += node.getInnerData() + _newline;
-                return s;
-            }
-
-            // opening and closing tags
-            s += "<" + node.getTagName();
-            for (auto i : node.getAllAttributes())
-            {
-                s += " " + i.first;
-                if (!i.second.empty())
-                    s += "=\"" + i.second + "\"";
-            }
-            if (node.getChildrenUID().empty()) // if no child nodes
-                s += " />" + _newline;         // closing tags
-            else
-            {
-                // close opening tag
-                s += ">" + _newline;
-                // add children nodes
-                for (auto i : node.getChildrenUID())
-                    s += _process_output_for_node(i, indent, indentation + indent, _newline);
-                // closing tag
-                s += indentation + "</" + node.getTagName() + ">" + _newline;
-            }
-
-            return s;
-        }
-
     public:
         /**
          * @brief Default constructor.
          */
         DOMparser() {}
 
+        /**
+         * @brief   Copy constructor, copies the tree only.
+         */
+        DOMparser(const DOMparser &parser)
+            : tree(parser.tree) {}
+
         /**
          * @brief   Deprecated. Constructs the tree from the provided data.
          * @param   data    the data
@@ -544,18 +894,392 @@ namespace dom_parser
          */
         inline int loadTree(std::filesystem::path path)
         {
-            return _parser(path);
+            return _parser(open_file_source(path));
+        }
+
+        /**
+         * @brief   Loads the tree from the given source utilisizing a tokenizer/lexer,
+         *          e.g. from a memory_source holding a document received over network.
+         * @param   source  source of the document
+         * @return  -2  error
+         *          0   if parsed successfully
+         */
+        inline int loadTree(std::unique_ptr<input_source> &&source)
+        {
+            return _parser(std::move(source));
+        }
+
+        /**
+         * @brief   Loads the tree from the file utilisizing a tokenizer/lexer,
+         *          recovering from syntax errors instead of failing: malformed
+         *          tags are dropped, mismatched elements are closed and parsing
+         *          goes on, see getDiagnostics() for what was found.
+         * @param   path    path of the file to be loaded
+         * @return  -2  if no root element could be read
+         *          0   if loaded, possibly with diagnostics
+         */
+        inline int loadTree_recover(std::filesystem::path path)
+        {
+            return _parser_recover(open_file_source(path));
+        }
+
+        /**
+         * @brief   Loads the tree from the given source recovering from syntax
+         *          errors, see loadTree_recover(path).
+         * @param   source  source of the document
+         * @return  -2  if no root element could be read
+         *          0   if loaded, possibly with diagnostics
+         */
+        inline int loadTree_recover(std::unique_ptr<input_source> &&source)
+        {
+            return _parser_recover(std::move(source));
+        }
+
+        /**
+         * @brief   Returns the problems found by the last loadTree_recover, in
+         *          input order.
+         */
+        inline const std::vector<parse_diagnostic> &getDiagnostics() const
+        {
+            return diagnostics;
+        }
+
+        /**
+         * @brief   Loads only the requested paths of the document, together with
+         *          their ancestors. Everything else is skipped without being
+         *          parsed, which pays off when a small part of a large document
+         *          is needed. Uses fast_parser, see loadTree_fast.
+         * @param   path    path of the file to be loaded
+         * @param   spec    paths to be built
+         * @return  -2  error
+         *          0   if parsed successfully
+         */
+        inline int loadTree(std::filesystem::path path, const projection &spec)
+        {
+            if (reuse_storage)
+                scanner.reuse(std::move(tree));
+            reuse_storage = false;
+            incremental = false;
+            return scanner.parse(open_file_source(path), tree, &spec);
+        }
+
+        /**
+         * @brief   Loads the tree from the file with the single pass fast_parser
+         *          instead of the lexer. The whole file is held in memory while
+         *          parsing.
+         * @param   path    path of the file to be loaded
+         * @return  -2  error
+         *          0   if parsed successfully
+         */
+        inline int loadTree_fast(std::filesystem::path path)
+        {
+            return loadTree_fast(open_file_source(path));
+        }
+
+        /**
+         * @brief   Loads the tree from the given source with fast_parser.
+         * @param   source  source of the document
+         * @return  -2  error
+         *          0   if parsed successfully
+         */
+        inline int loadTree_fast(std::unique_ptr<input_source> &&source)
+        {
+            if (reuse_storage)
+                scanner.reuse(std::move(tree));
+            reuse_storage = false;
+            incremental = false;
+            return scanner.parse(std::move(source), tree);
+        }
+
+        /**
+         * @brief   Parses a fragment of markup straight into a tree, adding its
+         *          nodes under an existing element without an intermediate
+         *          tree. The fragment may hold any number of elements and text
+         *          at its top level. Parsing into the tree of this parser ends
+         *          incremental mode.
+         * @param   target  tree receiving the nodes, borrowTree() for the tree
+         *                  of this parser
+         * @param   parent  element the nodes are added under
+         * @param   markup  UTF-8 markup of the fragment
+         * @param   after   child of the parent to follow, -1 for the first
+         *                  place, -2 (default) for the last place
+         * @return  -2  error, the tree is left untouched
+         *          -1  if the parent does not exist or stores inner data
+         *          0   if parsed successfully
+         */
+        inline int parseInto(DOMtree &target, DOMnodeUID parent, std::string_view markup, DOMnodeUID after = -2)
+        {
+            if (&target == &tree)
+                incremental = false;
+            return scanner.parse_fragment(markup, target, parent, after);
+        }
+
+        /**
+         * @brief   Parses a fragment read from the source straight into a tree,
+         *          see the overload taking the markup.
+         */
+        inline int parseInto(DOMtree &target, DOMnodeUID parent, std::unique_ptr<input_source> &&source,
+                             DOMnodeUID after = -2)
+        {
+            if (&target == &tree)
+                incremental = false;
+            return scanner.parse_fragment(std::move(source), target, parent, after);
+        }
+
+        /**
+         * @brief   Loads the tree with fast_parser and keeps the source text
+         *          and the byte range of every node, so that later edits of
+         *          the source can be applied with updateTree.
+         * @param   path    path of the file to be loaded
+         * @return  -2  error
+         *          0   if parsed successfully
+         */
+        inline int loadTree_incremental(std::filesystem::path path)
+        {
+            return loadTree_incremental(open_file_source(path));
+        }
+
+        /**
+         * @brief   Loads the tree from the given source in incremental mode.
+         * @param   source  source of the document
+         * @return  -2  error
+         *          0   if parsed successfully
+         */
+        int loadTree_incremental(std::unique_ptr<input_source> &&source)
+        {
+            if (reuse_storage)
+                scanner.reuse(std::move(tree));
+            reuse_storage = false;
+            incremental = false;
+            int res = scanner.parse(std::move(source), tree, source_spans);
+            if (res != 0)
+                return res;
+            source_text = scanner.release_input();
+            stale_element = -1;
+            incremental = true;
+            return 0;
+        }
+
+        /**
+         * @brief   Applies an edit of the source text to the tree loaded with
+         *          loadTree_incremental. Only the children of the innermost
+         *          element holding the edit which touch the edit are parsed
+         *          again and replaced, UIDs of all other nodes stay the same.
+         *          Edits touching the tags of the root re-parse everything.
+         *          If the edited part does not parse, the tree keeps its previous
+         *          content there and the part is parsed again with the next edit.
+         * @param   offset      byte offset of the edit in the UTF-8 source text
+         * @param   removed     number of bytes removed at the offset
+         * @param   inserted    text inserted at the offset
+         * @return  -2  if the edited part does not parse or the edit is out of range
+         *          -1  if the tree was not loaded in incremental mode
+         *          0   if the tree was updated
+         */
+        int updateTree(std::size_t offset, std::size_t removed, std::string_view inserted)
+        {
+            if (!incremental)
+                return -1;
+            if (offset > source_text.size() || removed > source_text.size() - offset)
+                return -2;
+
+            std::size_t edit_end = offset + removed;
+            std::ptrdiff_t delta = std::ptrdiff_t(inserted.size()) - std::ptrdiff_t(removed);
+            DOMnodeUID element = (stale_element == stale_document) ? -1 : _enclosing_element(offset, edit_end);
+            source_text.replace(offset, removed, inserted);
+            if (element == -1)
+            {
+                _shift_spans(edit_end, delta);
+                return _reparse_all();
+            }
+
+            // children touching the edit are parsed again, with the text
+            // between them and their untouched neighbours; text children next
+            // to them are parsed again too, as the edit may merge them
+            const node_span &span = source_spans[element];
+            std::size_t from = span.content_begin, to = span.content_end;
+            const auto &children = tree.getNode(element).getChildrenUID();
+            auto first = children.begin(), last = children.end();
+            if (element != stale_element)
+            {
+                while (first != children.end() && source_spans[*first].end < offset)
+                    ++first;
+                last = first;
+                while (last != children.end() && source_spans[*last].begin <= edit_end)
+                    ++last;
+                while (first != children.begin() && tree.getNode(*std::prev(first)).isInnerDataNode())
+                    --first;
+                while (last != children.end() && tree.getNode(*last).isInnerDataNode())
+                    ++last;
+                if (first != children.begin())
+                    from = source_spans[*std::prev(first)].end;
+                if (last != children.end())
+                    to = source_spans[*last].begin;
+            }
+            DOMnodeUID after = (first == children.begin()) ? -1 : *std::prev(first);
+            affected_nodes.assign(first, last);
+            _shift_spans(edit_end, delta);
+            to += delta;
+
+            if (_reparse_range(element, from, to, after) == 0)
+                return 0;
+            if (element == stale_element)
+            {
+                // the stale element failed again, the edit may have changed
+                // the structure around it, e.g. closed it and opened another
+                if (element == 0)
+                    return _reparse_all();
+                element = tree.getNode(element).getParent();
+                const auto &siblings = tree.getNode(element).getChildrenUID();
+                affected_nodes.assign(siblings.begin(), siblings.end());
+                if (_reparse_range(element, source_spans[element].content_begin,
+                                   source_spans[element].content_end, -1) == 0)
+                    return 0;
+            }
+
+            // the element and the stale one are parsed again as a whole later
+            while (stale_element != -1 && element != stale_element && !tree.isAncestor(element, stale_element))
+                element = tree.getNode(element).getParent();
+            stale_element = element;
+            return -2;
+        }
+
+        /**
+         * @brief   Returns the byte range [begin, end) of the node in the source
+         *          text, valid in incremental mode, see loadTree_incremental.
+         * @param   node    UID of the node
+         */
+        inline std::pair<std::size_t, std::size_t> getSourceRange(DOMnodeUID node) const
+        {
+            if (!incremental || node < 0 || std::size_t(node) >= source_spans.size())
+                return {0, 0};
+            return {source_spans[node].begin, source_spans[node].end};
+        }
+
+        /**
+         * @brief   Returns the source text with all edits applied, in
+         *          incremental mode.
+         */
+        inline const std::string &getSource() const
+        {
+            return source_text;
+        }
+
+#ifdef DOM_PARSER_HAS_MMAP
+        /**
+         * @brief   Loads a document too large for memory into a tree kept in
+         *          memory mapped files, see DOMmappedTree. The loaded tree of
+         *          the parser is left untouched.
+         * @param   path    path of the UTF-8 file to be loaded
+         * @param   mapped  tree created with DOMmappedTree::create
+         * @return  -2  error
+         *          0   if parsed successfully
+         */
+        inline int loadTree(std::filesystem::path path, DOMmappedTree &mapped)
+        {
+            return scanner.parse_mapped(path, mapped);
+        }
+#endif
+
+        /**
+         * @brief   Loads the file into a tree specialized for a schema known at
+         *          compile time, see DOMschemaTree. The loaded tree of the
+         *          parser is left untouched.
+         * @param   path    path of the file to be loaded
+         * @param   typed   tree replaced by the document
+         * @return  -2  error, typed is left empty
+         *          0   if parsed successfully
+         */
+        template <typename Schema>
+        inline int loadTree_fast(std::filesystem::path path, DOMschemaTree<Schema> &typed)
+        {
+            return loadTree_fast(open_file_source(path), typed);
+        }
+
+        /**
+         * @brief   Loads the document of the source into a tree specialized
+         *          for a schema, see the overload taking a path.
+         */
+        template <typename Schema>
+        int loadTree_fast(std::unique_ptr<input_source> &&source, DOMschemaTree<Schema> &typed)
+        {
+            typed.clear();
+            int res = scanner.parse_into(std::move(source), typed);
+            if (res != 0)
+                typed.clear();
+            return res;
+        }
+
+        /**
+         * @brief   Clears the loaded tree but keeps the node storage, the lexer
+         *          buffers and the parser stacks allocated, so the next load of
+         *          a similar document allocates little.
+         */
+        void reset()
+        {
+            tree.clear();
+            reuse_storage = true;
+            incremental = false;
+        }
+
+        /**
+         * @brief   Evaluates the queries registered in the matcher over the file
+         *          in a single streaming pass. No tree is built and the loaded
+         *          tree is left untouched, matches are reported through the
+         *          callbacks of the queries.
+         * @param   path    path of the file to be scanned
+         * @param   matcher queries to be evaluated
+         * @return  -2  error
+         *          0   if scanned successfully
+         */
+        inline int runQueries(std::filesystem::path path, stream_matcher &matcher)
+        {
+            return _run_queries(path, matcher);
+        }
+
+        /**
+         * @brief   Replaces the loaded tree with the given one, e.g. a tree
+         *          produced by DOMtreeBuilder, so it can be output.
+         * @param   _tree   the tree to take over
+         */
+        inline void setTree(DOMtree &&_tree)
+        {
+            tree = std::move(_tree);
+            incremental = false;
         }
 
         /**
          * @brief   Returns the loaded tree else the tree is blank
          *          with only one node - root node with blank tag name.
+         *          The copy has nodes of its own, see borrowTree and
+         *          releaseTree which avoid copying.
          */
         inline DOMtree getTree()
         {
             return tree;
         }
 
+        /**
+         * @brief   Returns a reference to the loaded tree, valid until the
+         *          next load or reset. In incremental mode the structure must
+         *          not be changed through it, the source ranges would not match.
+         */
+        inline DOMtree &borrowTree()
+        {
+            return tree;
+        }
+
+        /**
+         * @brief   Moves the loaded tree out of the parser, leaving the parser
+         *          with an empty tree.
+         */
+        inline DOMtree releaseTree()
+        {
+            DOMtree released(std::move(tree));
+            tree = DOMtree();
+            incremental = false;
+            return released;
+        }
+
         /**
          * @brief   Returns string of formatted document.
          * @param   minified    If output is required to be in minified form.
@@ -565,11 +1289,99 @@ namespace dom_parser
          * */
         std::string getOutput(bool minified = false, std::string indent = "    ", std::string indentation = "")
         {
-            // return _process_output_for_node(0, indent, indentation, (minified ? "" : "\n"));
-            if (minified)
-                return _process_output_for_node(0, "", "", "");
-            else
-                return _process_output_for_node(0, indent, indentation, "\n");
+            return tree_writer(tree, minified, indent, indentation).write();
+        }
+
+        /**
+         * @brief   Returns string of formatted subtree under the given node,
+         *          empty if the node does not exist.
+         * @param   node        Root node of the subtree.
+         * @param   minified    If output is required to be in minified form.
+         * @param   indent      string which denotes indentation, default is 4 spaces.
+         * @param   indentation indentation applied on the subtree root, default is empty.
+         * */
+        std::string getSubtreeOutput(DOMnodeUID node, bool minified = false, std::string indent = "    ",
+                                     std::string indentation = "")
+        {
+            return tree_writer(tree, minified, indent, indentation).write(node);
+        }
+
+        /**
+         * @brief   Returns string of formatted subtrees under the given nodes,
+         *          one after another. Nodes which do not exist are skipped.
+         * @param   nodes       Root nodes of the subtrees.
+         * @param   minified    If output is required to be in minified form.
+         * @param   indent      string which denotes indentation, default is 4 spaces.
+         * @param   indentation indentation applied on the subtree roots, default is empty.
+         * */
+        std::string getNodesOutput(const std::vector<DOMnodeUID> &nodes, bool minified = false,
+                                   std::string indent = "    ", std::string indentation = "")
+        {
+            return tree_writer(tree, minified, indent, indentation).write_nodes(nodes);
+        }
+
+        /**
+         * @brief   Returns a cursor handing out the formatted subtree under the
+         *          given node a bounded number of bytes at a time, see
+         *          tree_writer::cursor::next(). The tree must not be modified
+         *          while the cursor is in use.
+         * @param   node        Root node of the subtree, default is the root.
+         * @param   minified    If output is required to be in minified form.
+         * @param   indent      string which denotes indentation, default is 4 spaces.
+         * @param   indentation indentation applied on the subtree root, default is empty.
+         * */
+        tree_writer::cursor getOutputCursor(DOMnodeUID node = 0, bool minified = false,
+                                            std::string indent = "    ", std::string indentation = "")
+        {
+            return tree_writer(tree, minified, indent, indentation).make_cursor(node);
+        }
+
+        /**
+         * @brief   Returns a cursor handing out the formatted subtrees under the
+         *          given nodes a bounded number of bytes at a time, the same
+         *          output as getNodesOutput(). The tree must not be modified
+         *          while the cursor is in use.
+         * @param   nodes       Root nodes of the subtrees.
+         * @param   minified    If output is required to be in minified form.
+         * @param   indent      string which denotes indentation, default is 4 spaces.
+         * @param   indentation indentation applied on the subtree roots, default is empty.
+         * */
+        tree_writer::cursor getOutputCursor(std::vector<DOMnodeUID> nodes, bool minified = false,
+                                            std::string indent = "    ", std::string indentation = "")
+        {
+            return tree_writer(tree, minified, indent, indentation).make_cursor(std::move(nodes));
+        }
+
+        /**
+         * @brief   Returns string of formatted document, written by several
+         *          threads. The output is the same as getOutput().
+         * @param   threads     Number of threads, 0 for the hardware concurrency.
+         * @param   minified    If output is required to be in minified form.
+         * @param   indent      string which denotes indentation, default is 4 spaces.
+         * @param   indentation initial indentation of the output, that is the 
+         *                      indentation applied on root node, default is empty.
+         * */
+        std::string getOutput_parallel(unsigned threads = 0, bool minified = false,
+                                       std::string indent = "    ", std::string indentation = "")
+        {
+            return tree_writer(tree, minified, indent, indentation).write_parallel(0, threads);
+        }
+
+        /**
+         * @brief   Writes the formatted document to a file, written by several
+         *          threads without joining their buffers in memory first.
+         * @param   path        Output file path.
+         * @param   threads     Number of threads, 0 for the hardware concurrency.
+         * @param   minified    If output is required to be in minified form.
+         * @param   indent      string which denotes indentation, default is 4 spaces.
+         * @param   indentation initial indentation of the output, that is the 
+         *                      indentation applied on root node, default is empty.
+         * @return  0 on success, -2 if the file could not be written.
+         * */
+        int writeOutput(std::filesystem::path path, unsigned threads = 0, bool minified = false,
+                        std::string indent = "    ", std::string indentation = "")
+        {
+            return tree_writer(tree, minified, indent, indentation).write_parallel(path, 0, threads);
         }
 
         /**
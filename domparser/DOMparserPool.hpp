@@ -0,0 +1,94 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_PARSER_POOL
+#define DOM_PARSER_DOM_PARSER_POOL
+
+#include <memory>
+#include <vector>
+
+#include "DOMparser.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Thread local pool of DOMparser instances for parsing many small
+     *          documents. A parser returned to the pool is reset(), so it keeps
+     *          its storage for the next document parsed on the same thread.
+     * */
+    class DOMparserPool
+    {
+    private:
+        /**
+         *  @brief  Returns the parsers available to the calling thread.
+         * */
+        static std::vector<std::unique_ptr<DOMparser>> &idle()
+        {
+            thread_local std::vector<std::unique_ptr<DOMparser>> parsers;
+            return parsers;
+        }
+
+    public:
+        /**
+         *  @brief  Parser borrowed from the pool, given back on destruction.
+         *          Must be given back on the thread which acquired it.
+         * */
+        class handle
+        {
+        private:
+            std::unique_ptr<DOMparser> parser;
+
+        public:
+            handle(std::unique_ptr<DOMparser> &&_parser)
+                : parser(std::move(_parser)) {}
+            handle(handle &&other) = default;
+
+            ~handle()
+            {
+                if (!parser)
+                    return;
+                parser->reset();
+                idle().push_back(std::move(parser));
+            }
+
+            inline DOMparser &operator*()
+            {
+                return *parser;
+            }
+
+            inline DOMparser *operator->()
+            {
+                return parser.get();
+            }
+        };
+
+        /**
+         *  @brief  Borrows a parser, creating one if the pool of the calling
+         *          thread is empty.
+         * */
+        static handle acquire()
+        {
+            auto &parsers = idle();
+            if (parsers.empty())
+                return handle(std::unique_ptr<DOMparser>(new DOMparser()));
+
+            std::unique_ptr<DOMparser> parser = std::move(parsers.back());
+            parsers.pop_back();
+            return handle(std::move(parser));
+        }
+    };
+} // namespace dom_parser
+
+#endif
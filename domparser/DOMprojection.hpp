@@ -0,0 +1,243 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_PROJECTION
+#define DOM_PARSER_DOM_PROJECTION
+
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Set of absolute paths which limits what gets built while parsing.
+     *          A path to an element, like /root/item/title, builds the element
+     *          with its whole subtree. A path to an attribute, like
+     *          /root/item/price/\@currency, builds the element with only that
+     *          attribute. Ancestors of what is requested are built without
+     *          attributes or text. A step may be * to match any name.
+     * */
+    class projection
+    {
+    private:
+        // trie of the added paths
+        struct step
+        {
+            std::string name;
+            std::vector<int> children;
+            std::vector<std::string> attributes;
+            bool whole = false;
+        };
+
+        // steps[0] is above the root element
+        std::vector<step> steps = std::vector<step>(1);
+
+        // an element can be at several steps at once, e.g. at both /r/*/x
+        // and /r/a/y below <r><a>, so elements are matched against sets of
+        // steps; each set is a state, with its moves and merged requests
+        struct state
+        {
+            std::vector<int> at; // sorted steps in the set
+            std::vector<std::pair<std::string, int>> moves;
+            int other = -1; // move on a name matched only by *
+            std::vector<std::string> attributes;
+            bool whole = false;
+        };
+
+        // states[0] is the set of steps[0]
+        std::vector<state> states = std::vector<state>(1);
+
+        /**
+         *  @brief  Gets the state of a set of steps, adding it if new.
+         *  @param  at  sorted steps, empty for no state
+         *  @return index of the state, -1 for an empty set
+         * */
+        int intern(std::vector<int> &&at)
+        {
+            if (at.empty())
+                return -1;
+            for (std::size_t i = 0; i < states.size(); i++)
+                if (states[i].at == at)
+                    return i;
+            states.emplace_back();
+            states.back().at = std::move(at);
+            return states.size() - 1;
+        }
+
+        /**
+         *  @brief  Rebuilds the states from the trie.
+         * */
+        void build_states()
+        {
+            states.assign(1, state());
+            states[0].at = {0};
+            for (std::size_t i = 0; i < states.size(); i++)
+            {
+                std::vector<std::string> names;
+                for (int at : states[i].at)
+                {
+                    if (steps[at].whole)
+                        states[i].whole = true;
+                    for (const auto &attribute : steps[at].attributes)
+                        if (std::find(names.begin(), names.end(), attribute) == names.end())
+                            names.push_back(attribute);
+                }
+                states[i].attributes = std::move(names);
+
+                names.clear();
+                for (int at : states[i].at)
+                    for (int child : steps[at].children)
+                        if (steps[child].name != "*" &&
+                            std::find(names.begin(), names.end(), steps[child].name) == names.end())
+                            names.push_back(steps[child].name);
+
+                std::vector<std::pair<std::string, int>> moves;
+                for (auto &name : names)
+                {
+                    int next = intern(targets(states[i].at, name));
+                    moves.emplace_back(std::move(name), next);
+                }
+                int other = intern(targets(states[i].at, "*"));
+                states[i].moves = std::move(moves); // intern may have moved states
+                states[i].other = other;
+            }
+        }
+
+        /**
+         *  @brief  Returns the sorted children of the steps which match the
+         *          name, * children match any name.
+         * */
+        std::vector<int> targets(const std::vector<int> &from, const std::string &name) const
+        {
+            std::vector<int> to;
+            for (int at : from)
+                for (int child : steps[at].children)
+                    if (steps[child].name == name || steps[child].name == "*")
+                        to.push_back(child);
+            std::sort(to.begin(), to.end());
+            return to;
+        }
+
+        /**
+         *  @brief  Adds a path to the trie.
+         * */
+        bool insert(const std::string &path)
+        {
+            if (path.empty() || path[0] != '/')
+                return false;
+
+            int current = 0;
+            std::size_t begin = 1;
+            while (begin <= path.size())
+            {
+                std::size_t end = path.find('/', begin);
+                if (end == std::string::npos)
+                    end = path.size();
+                std::string name = path.substr(begin, end - begin);
+                if (name.empty())
+                    return false;
+
+                if (name[0] == '@') // attribute, must be the last step
+                {
+                    if (end != path.size() || current == 0 || name.size() == 1)
+                        return false;
+                    steps[current].attributes.push_back(name.substr(1));
+                    return true;
+                }
+
+                int next = -1;
+                for (int child : steps[current].children)
+                    if (steps[child].name == name)
+                        next = child;
+                if (next == -1)
+                {
+                    next = steps.size();
+                    steps.emplace_back();
+                    steps[next].name = name;
+                    steps[current].children.push_back(next);
+                }
+                current = next;
+                begin = end + 1;
+            }
+
+            steps[current].whole = true;
+            return true;
+        }
+
+    public:
+        projection() {}
+
+        /**
+         *  @brief  Constructor
+         *  @param  paths   paths to be added
+         * */
+        projection(std::initializer_list<std::string> paths)
+        {
+            for (const auto &path : paths)
+                add(path);
+        }
+
+        /**
+         *  @brief  Adds a path to the projection.
+         *  @param  path    absolute path, steps separated by '/', optionally
+         *                  ending with an \@attribute step
+         *  @return false if the path is malformed
+         * */
+        bool add(const std::string &path)
+        {
+            bool added = insert(path);
+            build_states();
+            return added;
+        }
+
+        /**
+         *  @brief  Returns the state an element moves to, -1 if the element
+         *          is not requested.
+         *  @param  parent  state of the parent element, 0 for the root element
+         *  @param  name    tag name of the element
+         * */
+        inline int child(int parent, std::string_view name) const
+        {
+            for (const auto &move : states[parent].moves)
+                if (move.first == name)
+                    return move.second;
+            return states[parent].other;
+        }
+
+        /**
+         *  @brief  Checks if the element at the state is requested as a whole.
+         * */
+        inline bool whole(int at) const
+        {
+            return states[at].whole;
+        }
+
+        /**
+         *  @brief  Checks if an attribute is requested at the state.
+         * */
+        inline bool wants_attribute(int at, std::string_view name) const
+        {
+            for (const auto &attribute : states[at].attributes)
+                if (attribute == name)
+                    return true;
+            return false;
+        }
+    };
+} // namespace dom_parser
+
+#endif
@@ -0,0 +1,623 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_SCHEMA
+#define DOM_PARSER_DOM_SCHEMA
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "DOMnodeUID.hpp"
+#include "DOMvalue.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Seeded FNV-1a hash of a name, used by schema_names.
+     * */
+    constexpr std::uint32_t schema_hash(std::uint32_t seed, std::string_view name)
+    {
+        std::uint32_t h = seed ^ (static_cast<std::uint32_t>(name.size()) * 0x9e3779b9u);
+        for (char c : name)
+            h = (h ^ static_cast<unsigned char>(c)) * 0x01000193u;
+        return h ^ (h >> 16);
+    }
+
+    /**
+     *  @brief  Perfect hash over a list of names known at compile time. The
+     *          compiler searches a seed for which no two names share a slot
+     *          of the table, so a lookup is one hash, one table read and one
+     *          comparison. Lookups are constexpr and can label switch cases.
+     *  @tparam N   number of names, at most 256: the seed search runs in the
+     *              compiler and the table has N^2 / 2 slots, so 256 names cost
+     *              a 64 KiB table and a few seconds of compilation, and
+     *              near 450 names GCC stops at its constant evaluation limit
+     * */
+    template <std::size_t N>
+    class schema_names
+    {
+    public:
+        // a power of two of at least N^2 / 2 slots, a seed is then free of
+        // collisions with a probability of about 1/e and few are tried
+        static constexpr std::size_t table_size()
+        {
+            std::size_t size = 8;
+            while (size < N * N / 2)
+                size *= 2;
+            return size;
+        }
+
+    private:
+        static_assert(N <= 256, "schema_names holds at most 256 names");
+
+        std::array<std::string_view, N> names{};
+        std::array<std::int16_t, table_size()> table{};
+        std::uint32_t seed = 0;
+        bool distinct = true;
+
+        constexpr std::size_t slot(std::uint32_t s, std::string_view name) const
+        {
+            return schema_hash(s, name) & (table_size() - 1);
+        }
+
+        /**
+         *  @brief  Searches the first seed placing every name in a slot of its
+         *          own. Slots are marked with the seed tried, so the marks need
+         *          no clearing between tries.
+         * */
+        constexpr std::uint32_t find_seed() const
+        {
+            std::array<std::uint32_t, table_size()> taken{};
+            for (std::uint32_t s = 0;; ++s)
+            {
+                std::size_t i = 0;
+                for (; i < N; ++i)
+                {
+                    std::uint32_t &mark = taken[slot(s, names[i])];
+                    if (mark == s + 1)
+                        break;
+                    mark = s + 1;
+                }
+                if (i == N)
+                    return s;
+            }
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  list    array of the names, their index is their value
+         * */
+        template <typename List>
+        constexpr schema_names(const List &list)
+        {
+            for (std::size_t i = 0; i < N; ++i)
+                names[i] = list[i];
+            for (std::size_t i = 0; i < N; ++i)
+                for (std::size_t j = i + 1; j < N; ++j)
+                    if (names[i] == names[j])
+                        distinct = false;
+            for (auto &entry : table)
+                entry = -1;
+            if (!distinct) // no seed would do
+                return;
+            seed = find_seed();
+            for (std::size_t i = 0; i < N; ++i)
+                table[slot(seed, names[i])] = static_cast<std::int16_t>(i);
+        }
+
+        /**
+         *  @brief  Returns the index of the name in the list, -1 if the name
+         *          is not in the list.
+         * */
+        constexpr int find(std::string_view name) const
+        {
+            int i = table[slot(seed, name)];
+            return (i != -1 && names[i] == name) ? i : -1;
+        }
+
+        /**
+         *  @brief  Returns the name at the index.
+         * */
+        constexpr std::string_view name(int i) const
+        {
+            return names[i];
+        }
+
+        constexpr std::size_t size() const
+        {
+            return N;
+        }
+
+        /**
+         *  @brief  Returns false if the list holds a name twice.
+         * */
+        constexpr bool valid() const
+        {
+            return distinct;
+        }
+    };
+
+    /**
+     *  @brief  String kept in the string storage of a DOMschemaTree.
+     * */
+    struct schema_string
+    {
+        std::size_t offset;
+        std::uint32_t length;
+    };
+
+    /**
+     *  @brief  Node as stored in a DOMschemaTree.
+     * */
+    struct schema_node_record
+    {
+        DOMnodeUID parent;
+        DOMnodeUID first_child;
+        DOMnodeUID last_child;
+        DOMnodeUID next_sibling;
+        int kind;                  // index of the tag name in the schema, or a *_kind value
+        schema_string text;        // inner data, or the tag name of an element not in the schema
+        std::size_t slot_begin;    // first attribute slot of the node
+        std::size_t unknown_begin; // first attribute not in the schema
+        std::uint32_t unknown_count;
+    };
+
+    template <typename Schema>
+    class DOMschemaTree;
+
+    /**
+     *  @brief  Read only view of a node in a DOMschemaTree, offering the
+     *          navigation API of DOMnode. Strings are returned as views into
+     *          the tree, valid while the tree is not added to.
+     * */
+    template <typename Schema>
+    class DOMschemaNode
+    {
+    private:
+        const DOMschemaTree<Schema> *tree;
+        DOMnodeUID uid;
+
+        inline const schema_node_record &record() const
+        {
+            return tree->nodes[uid];
+        }
+
+        inline std::string_view text(schema_string s) const
+        {
+            return tree->view(s);
+        }
+
+    public:
+        /**
+         *  @brief  Range over the children UIDs, following the sibling links.
+         * */
+        class children_range
+        {
+        private:
+            const DOMschemaTree<Schema> *tree;
+            DOMnodeUID first;
+
+        public:
+            class iterator
+            {
+            private:
+                const DOMschemaTree<Schema> *tree;
+                DOMnodeUID uid;
+
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef DOMnodeUID value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const DOMnodeUID *pointer;
+                typedef const DOMnodeUID &reference;
+
+                iterator(const DOMschemaTree<Schema> *_tree, DOMnodeUID _uid)
+                    : tree(_tree), uid(_uid) {}
+                inline DOMnodeUID operator*() const
+                {
+                    return uid;
+                }
+                inline iterator &operator++()
+                {
+                    uid = tree->nodes[uid].next_sibling;
+                    return *this;
+                }
+                inline bool operator==(const iterator &other) const
+                {
+                    return uid == other.uid;
+                }
+                inline bool operator!=(const iterator &other) const
+                {
+                    return uid != other.uid;
+                }
+            };
+
+            children_range(const DOMschemaTree<Schema> *_tree, DOMnodeUID _first)
+                : tree(_tree), first(_first) {}
+            inline iterator begin() const
+            {
+                return iterator(tree, first);
+            }
+            inline iterator end() const
+            {
+                return iterator(tree, -1);
+            }
+            inline bool empty() const
+            {
+                return first == -1;
+            }
+        };
+
+        DOMschemaNode(const DOMschemaTree<Schema> *_tree, DOMnodeUID _uid)
+            : tree(_tree), uid(_uid) {}
+
+        inline DOMnodeUID getUID() const
+        {
+            return uid;
+        }
+
+        inline DOMnodeUID getParent() const
+        {
+            return record().parent;
+        }
+
+        /**
+         *  @brief  Returns the index of the tag name in the schema,
+         *          DOMschemaTree::unknown_kind for other elements and
+         *          DOMschemaTree::text_kind for inner-data nodes.
+         * */
+        inline int getKind() const
+        {
+            return record().kind;
+        }
+
+        inline bool isInnerDataNode() const
+        {
+            return record().kind == DOMschemaTree<Schema>::text_kind;
+        }
+
+        /**
+         *  @brief  Returns the tag name, empty for inner-data nodes.
+         * */
+        inline std::string_view getTagName() const
+        {
+            const schema_node_record &r = record();
+            if (r.kind >= 0)
+                return DOMschemaTree<Schema>::tag_names.name(r.kind);
+            return r.kind == DOMschemaTree<Schema>::unknown_kind ? text(r.text) : std::string_view();
+        }
+
+        /**
+         *  @brief  Returns the inner data, empty for element nodes.
+         * */
+        inline std::string_view getInnerData() const
+        {
+            const schema_node_record &r = record();
+            return r.kind == DOMschemaTree<Schema>::text_kind ? text(r.text) : std::string_view();
+        }
+
+        inline children_range getChildrenUID() const
+        {
+            return children_range(tree, record().first_child);
+        }
+
+        /**
+         *  @brief  Checks if the attribute of the slot is set.
+         *  @param  slot    index of the attribute in the schema, see
+         *                  DOMschemaTree::slot
+         * */
+        inline bool hasAttribute(int slot) const
+        {
+            return !isInnerDataNode() && tree->slots[record().slot_begin + slot].length != tree->absent;
+        }
+
+        /**
+         *  @brief  Gets the value of the attribute of the slot, empty if the
+         *          attribute is not set. No name is looked up.
+         *  @param  slot    index of the attribute in the schema, see
+         *                  DOMschemaTree::slot
+         * */
+        inline std::string_view getAttribute(int slot) const
+        {
+            return hasAttribute(slot) ? text(tree->slots[record().slot_begin + slot]) : std::string_view();
+        }
+
+        /**
+         *  @brief  Checks if the node has the said attribute, in the schema
+         *          or not.
+         * */
+        inline bool hasAttribute(std::string_view attribute) const
+        {
+            int slot = DOMschemaTree<Schema>::slot(attribute);
+            if (slot != -1)
+                return hasAttribute(slot);
+            for (std::size_t i = 0; i < getUnknownAttributeCount(); ++i)
+                if (getUnknownAttributeAt(i).first == attribute)
+                    return true;
+            return false;
+        }
+
+        /**
+         *  @brief  Gets the value of the said attribute, in the schema or
+         *          not, empty if the attribute does not exist.
+         * */
+        inline std::string_view getAttribute(std::string_view attribute) const
+        {
+            int slot = DOMschemaTree<Schema>::slot(attribute);
+            if (slot != -1)
+                return getAttribute(slot);
+            for (std::size_t i = 0; i < getUnknownAttributeCount(); ++i)
+            {
+                auto a = getUnknownAttributeAt(i);
+                if (a.first == attribute)
+                    return a.second;
+            }
+            return std::string_view();
+        }
+
+        /**
+         *  @brief  Reads the attribute of the slot as an integer.
+         *  @return 0 if read, -1 if the attribute is not set, -2 if its value
+         *          is not an integer
+         * */
+        inline int getInt(int slot, long long &value) const
+        {
+            return getValue(slot, value);
+        }
+
+        /**
+         *  @brief  Reads the attribute of the slot as a floating point number.
+         *  @return 0 if read, -1 if the attribute is not set, -2 if its value
+         *          is not a number
+         * */
+        inline int getDouble(int slot, double &value) const
+        {
+            return getValue(slot, value);
+        }
+
+        /**
+         *  @brief  Reads the attribute of the slot as a boolean.
+         *  @return 0 if read, -1 if the attribute is not set, -2 if its value
+         *          is not a boolean
+         * */
+        inline int getBool(int slot, bool &value) const
+        {
+            return getValue(slot, value);
+        }
+
+        /**
+         *  @brief  Returns the number of attributes not in the schema.
+         * */
+        inline std::size_t getUnknownAttributeCount() const
+        {
+            return record().unknown_count;
+        }
+
+        /**
+         *  @brief  Returns the name and value of the i-th attribute not in the
+         *          schema, in document order.
+         * */
+        inline std::pair<std::string_view, std::string_view> getUnknownAttributeAt(std::size_t i) const
+        {
+            const auto &a = tree->unknown[record().unknown_begin + i];
+            return {text(a.first), text(a.second)};
+        }
+
+    private:
+        template <typename T>
+        inline int getValue(int slot, T &value) const
+        {
+            if (!hasAttribute(slot))
+                return -1;
+            return parse_value(getAttribute(slot), value) ? 0 : -2;
+        }
+    };
+
+    /**
+     *  @brief  Tree specialized for documents whose tag and attribute names
+     *          are known at compile time. The schema is a type listing them:
+     *
+     *              struct feed
+     *              {
+     *                  static constexpr std::string_view tags[] = {"feed", "item", "price"};
+     *                  static constexpr std::array<std::string_view, 1> attributes = {"id"};
+     *              };
+     *
+     *          Elements are stored with the index of their tag name, their
+     *          kind, instead of the name, and attributes of the schema go to
+     *          fixed slots of the element instead of a map. Names are looked
+     *          up through a perfect hash built by the compiler. Elements and
+     *          attributes not in the schema keep their names as strings.
+     *          Nodes live in flat arrays linked through first child and next
+     *          sibling UIDs, strings in one shared buffer.
+     *
+     *          Nodes are added with open/attr/text/close in document order, the
+     *          same calls as DOMtreeBuilder, so fast_parser can fill it directly
+     *          through fast_parser::parse_into, the parser being instantiated
+     *          for the schema. Attributes are set right after their element
+     *          is opened.
+     * */
+    template <typename Schema>
+    class DOMschemaTree
+    {
+        friend class DOMschemaNode<Schema>;
+
+    public:
+        static constexpr schema_names<std::size(Schema::tags)> tag_names{Schema::tags};
+        static constexpr schema_names<std::size(Schema::attributes)> attribute_names{Schema::attributes};
+        static_assert(tag_names.valid(), "the tag names of the schema must be distinct");
+        static_assert(attribute_names.valid(), "the attribute names of the schema must be distinct");
+
+        static constexpr int unknown_kind = -1; // element with a tag name not in the schema
+        static constexpr int text_kind = -2;    // inner-data node
+
+        /**
+         *  @brief  Returns the kind of the elements with the tag name,
+         *          unknown_kind if it is not in the schema.
+         * */
+        static constexpr int kind(std::string_view tag_name)
+        {
+            return tag_names.find(tag_name);
+        }
+
+        /**
+         *  @brief  Returns the slot of the attribute, -1 if it is not in the
+         *          schema.
+         * */
+        static constexpr int slot(std::string_view attribute)
+        {
+            return attribute_names.find(attribute);
+        }
+
+    private:
+        static constexpr std::uint32_t absent = std::uint32_t(-1); // length of an unset slot
+
+        std::vector<schema_node_record> nodes;
+        std::vector<schema_string> slots; // attribute_names.size() slots per element
+        std::vector<std::pair<schema_string, schema_string>> unknown;
+        std::string strings;
+        std::vector<DOMnodeUID> open_elements;
+
+        inline schema_string store(std::string_view s)
+        {
+            schema_string stored{strings.size(), std::uint32_t(s.size())};
+            strings.append(s.data(), s.size());
+            return stored;
+        }
+
+        inline std::string_view view(schema_string s) const
+        {
+            return std::string_view(strings.data() + s.offset, s.length);
+        }
+
+        /**
+         *  @brief  Appends a node under the innermost open element.
+         * */
+        DOMnodeUID append(int kind, std::string_view text)
+        {
+            DOMnodeUID uid = DOMnodeUID(nodes.size());
+            DOMnodeUID parent = open_elements.empty() ? -1 : open_elements.back();
+            nodes.emplace_back();
+            schema_node_record &r = nodes.back();
+            r.parent = parent;
+            r.first_child = r.last_child = r.next_sibling = -1;
+            r.kind = kind;
+            r.text = text.empty() ? schema_string{0, 0} : store(text);
+            r.slot_begin = slots.size();
+            r.unknown_begin = unknown.size();
+            r.unknown_count = 0;
+
+            if (parent != -1)
+            {
+                schema_node_record &p = nodes[parent];
+                if (p.last_child == -1)
+                    p.first_child = uid;
+                else
+                    nodes[p.last_child].next_sibling = uid;
+                p.last_child = uid;
+            }
+            return uid;
+        }
+
+    public:
+        DOMschemaTree() {}
+
+        /**
+         *  @brief  Removes all the nodes but keeps the storage for the next
+         *          document.
+         * */
+        void clear()
+        {
+            nodes.clear();
+            slots.clear();
+            unknown.clear();
+            strings.clear();
+            open_elements.clear();
+        }
+
+        DOMschemaTree &open(std::string_view name)
+        {
+            int k = kind(name);
+            DOMnodeUID uid = append(k, k == unknown_kind ? name : std::string_view());
+            slots.resize(slots.size() + attribute_names.size(), schema_string{0, absent});
+            open_elements.push_back(uid);
+            return *this;
+        }
+
+        /**
+         *  @brief  Sets an attribute on the innermost open element, a repeated
+         *          name overwrites the earlier value.
+         * */
+        DOMschemaTree &attr(std::string_view attribute, std::string_view value)
+        {
+            schema_node_record &r = nodes[open_elements.back()];
+            int s = slot(attribute);
+            if (s != -1)
+            {
+                slots[r.slot_begin + s] = store(value);
+                return *this;
+            }
+
+            for (std::uint32_t i = 0; i < r.unknown_count; ++i)
+            {
+                auto &existing = unknown[r.unknown_begin + i];
+                if (view(existing.first) == attribute)
+                {
+                    existing.second = store(value);
+                    return *this;
+                }
+            }
+            unknown.emplace_back(store(attribute), store(value));
+            ++r.unknown_count;
+            return *this;
+        }
+
+        inline DOMschemaTree &text(std::string_view data)
+        {
+            append(text_kind, data);
+            return *this;
+        }
+
+        inline DOMschemaTree &close()
+        {
+            open_elements.pop_back();
+            return *this;
+        }
+
+        /**
+         *  @brief  Returns the number of nodes in the tree.
+         * */
+        inline DOMnodeUID getNodeCount() const
+        {
+            return DOMnodeUID(nodes.size());
+        }
+
+        /**
+         *  @brief  Returns a view of the node with given UID.
+         * */
+        inline DOMschemaNode<Schema> getNode(DOMnodeUID node) const
+        {
+            return DOMschemaNode<Schema>(this, node);
+        }
+    };
+} // namespace dom_parser
+
+#endif
@@ -0,0 +1,310 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_STREAM_QUERY
+#define DOM_PARSER_DOM_STREAM_QUERY
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "DOMnode.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  A match reported by stream_matcher.
+     * */
+    struct query_match
+    {
+        int query;                                              // id returned by stream_matcher::add
+        const std::string &tag_name;                            // matched element
+        const DOMattributes &attributes;  // attributes of the matched element
+        std::string_view value; // text inside the element, or the attribute value for /@name queries
+    };
+
+    /**
+     *  @brief  Evaluates many path queries in one pass over a stream of
+     *          element events, without building a tree. Queries are made of
+     *          child (/) and descendant (//) steps with a name or *, each step
+     *          optionally followed by predicates [\@attr] or [\@attr='value'],
+     *          and an optional final /\@attr step. Memory is bounded by the
+     *          depth of the document times the number of queries, plus the
+     *          text of the elements being matched.
+     * */
+    class stream_matcher
+    {
+    public:
+        typedef std::function<void(const query_match &)> callback;
+
+    private:
+        struct step
+        {
+            std::string name;
+            bool descendant = false;
+            std::vector<std::pair<std::string, std::string>> predicates;
+            std::vector<bool> predicate_has_value;
+        };
+
+        struct query
+        {
+            std::vector<step> steps;
+            std::string attribute; // final /@attribute step, empty if none
+            callback on_match;
+        };
+
+        struct open_match
+        {
+            int query;
+            std::size_t depth;
+            std::size_t text_begin;
+            std::string tag_name;
+            DOMattributes attributes;
+        };
+
+        std::vector<query> queries;
+
+        // automaton states (query, step) active for the children of each
+        // open element, frames[d] is where the states of depth d begin
+        std::vector<std::pair<int, std::size_t>> states;
+        std::vector<std::size_t> frames;
+
+        // (query, step) states are numbered from step_base[query], marks are
+        // set for the states of the frame being built so none is added twice
+        std::vector<std::size_t> step_base;
+        std::vector<bool> marks;
+
+        std::vector<open_match> matches; // matched elements still open
+        std::string text;                // text collected for open matches
+
+        /**
+         *  @brief  Parses one step starting at pos.
+         *  @return false if the expression is malformed
+         * */
+        static bool parse_step(const std::string &expr, std::size_t &pos, step &s)
+        {
+            std::size_t end = expr.find_first_of("/[", pos);
+            if (end == std::string::npos)
+                end = expr.size();
+            s.name = expr.substr(pos, end - pos);
+            if (s.name.empty())
+                return false;
+            pos = end;
+
+            while (pos < expr.size() && expr[pos] == '[')
+            {
+                std::size_t close = expr.find(']', pos);
+                if (close == std::string::npos || expr[pos + 1] != '@')
+                    return false;
+                std::string predicate = expr.substr(pos + 2, close - pos - 2);
+                std::size_t eq = predicate.find('=');
+                if (eq == std::string::npos)
+                {
+                    s.predicates.emplace_back(predicate, "");
+                    s.predicate_has_value.push_back(false);
+                }
+                else
+                {
+                    std::string value = predicate.substr(eq + 1);
+                    if (value.size() < 2 || (value[0] != '\'' && value[0] != '\"') || value.back() != value[0])
+                        return false;
+                    s.predicates.emplace_back(predicate.substr(0, eq), value.substr(1, value.size() - 2));
+                    s.predicate_has_value.push_back(true);
+                }
+                pos = close + 1;
+            }
+            return true;
+        }
+
+        /**
+         *  @brief  Adds a state to the frame being built unless it is there.
+         * */
+        inline void push_state(int query, std::size_t step)
+        {
+            std::size_t mark = step_base[query] + step;
+            if (marks[mark])
+                return;
+            marks[mark] = true;
+            states.emplace_back(query, step);
+        }
+
+        /**
+         *  @brief  Checks if an element satisfies a step.
+         * */
+        static bool step_matches(const step &s, const std::string &tag_name,
+                                 const DOMattributes &attributes)
+        {
+            if (s.name != "*" && s.name != tag_name)
+                return false;
+            for (std::size_t i = 0; i < s.predicates.size(); ++i)
+            {
+                auto attribute = attributes.find(s.predicates[i].first);
+                if (attribute == attributes.end())
+                    return false;
+                if (s.predicate_has_value[i] && attribute->second != s.predicates[i].second)
+                    return false;
+            }
+            return true;
+        }
+
+    public:
+        /**
+         *  @brief  Registers a query.
+         *  @param  expr        path expression, like //item[\@type='book']/title
+         *  @param  on_match    called for every match, after the matched element
+         *                      is closed, or right away for /\@attr queries
+         *  @return id of the query, -1 if the expression is malformed
+         * */
+        int add(const std::string &expr, callback on_match)
+        {
+            query q;
+            q.on_match = std::move(on_match);
+            std::size_t pos = 0;
+            while (pos < expr.size())
+            {
+                if (expr[pos] != '/')
+                    return -1;
+                step s;
+                if (expr.compare(pos, 2, "//") == 0)
+                {
+                    s.descendant = true;
+                    pos += 2;
+                }
+                else
+                    ++pos;
+
+                if (pos < expr.size() && expr[pos] == '@') // final attribute step
+                {
+                    if (s.descendant || q.steps.empty() || expr.find('/', pos) != std::string::npos)
+                        return -1;
+                    q.attribute = expr.substr(pos + 1);
+                    if (q.attribute.empty())
+                        return -1;
+                    break;
+                }
+                if (!parse_step(expr, pos, s))
+                    return -1;
+                q.steps.push_back(std::move(s));
+            }
+            if (q.steps.empty())
+                return -1;
+
+            step_base.push_back(marks.size());
+            marks.resize(marks.size() + q.steps.size());
+            queries.push_back(std::move(q));
+            reset();
+            return queries.size() - 1;
+        }
+
+        /**
+         *  @brief  Prepares for a new document, registered queries are kept.
+         * */
+        void reset()
+        {
+            states.clear();
+            frames.clear();
+            matches.clear();
+            text.clear();
+            frames.push_back(0);
+            for (std::size_t q = 0; q < queries.size(); ++q)
+                states.emplace_back(q, 0);
+            frames.push_back(states.size());
+        }
+
+        /**
+         *  @brief  Advances the automaton on an opening tag.
+         * */
+        void start_element(const std::string &tag_name, const DOMattributes &attributes)
+        {
+            std::size_t begin = frames[frames.size() - 2];
+            std::size_t end = frames.back();
+            std::size_t depth = frames.size() - 1;
+
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                std::pair<int, std::size_t> state = states[i]; // copied, states grows below
+                const query &q = queries[state.first];
+                const step &s = q.steps[state.second];
+
+                if (s.descendant) // keeps looking further down
+                    push_state(state.first, state.second);
+                if (!step_matches(s, tag_name, attributes))
+                    continue;
+
+                if (state.second + 1 < q.steps.size())
+                {
+                    push_state(state.first, state.second + 1);
+                    continue;
+                }
+
+                if (!q.attribute.empty()) // attribute query, reported right away
+                {
+                    auto attribute = attributes.find(q.attribute);
+                    if (attribute != attributes.end())
+                        q.on_match(query_match{state.first, tag_name, attributes, attribute->second});
+                }
+                else
+                {
+                    if (!text.empty() && text.back() != ' ')
+                        text += ' ';
+                    matches.push_back(open_match{state.first, depth, text.size(), tag_name, attributes});
+                }
+            }
+            for (std::size_t i = end; i < states.size(); ++i)
+                marks[step_base[states[i].first] + states[i].second] = false;
+            frames.push_back(states.size());
+        }
+
+        /**
+         *  @brief  Passes text inside the current element.
+         * */
+        void text_data(std::string_view data)
+        {
+            if (matches.empty())
+                return;
+            if (text.size() != matches.back().text_begin && text.back() != ' ')
+                text += ' ';
+            text.append(data.data(), data.size());
+        }
+
+        /**
+         *  @brief  Advances the automaton on a closing tag, reporting the
+         *          matches of the element being closed.
+         * */
+        void end_element()
+        {
+            std::size_t depth = frames.size() - 2;
+            while (!matches.empty() && matches.back().depth == depth)
+            {
+                const open_match &m = matches.back();
+                std::string_view value(text.data() + m.text_begin, text.size() - m.text_begin);
+                if (!value.empty() && value.back() == ' ')
+                    value.remove_suffix(1);
+                queries[m.query].on_match(query_match{m.query, m.tag_name, m.attributes, value});
+                matches.pop_back();
+            }
+            if (matches.empty())
+                text.clear();
+
+            frames.pop_back();
+            states.resize(frames.back());
+        }
+    };
+} // namespace dom_parser
+
+#endif
@@ -15,27 +15,81 @@
 #ifndef DOM_PARSER_DOM_TREE
 #define DOM_PARSER_DOM_TREE
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <list>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <queue>
 
+#include "DOMhash.hpp"
 #include "DOMnode.hpp"
+#include "DOMvalue.hpp"
 
 namespace dom_parser
 {
-    class DOMtree
+    class DOMtreeBuilder;
+    class DOMfragmentBuilder;
+    class tree_differ;
+    class tree_writer;
+
+    /// @brief   Storage of DOMtree. Kept apart so that DOMtree copies and
+    ///          moves it member-wise and only fixes up the nodes afterwards.
+    struct tree_storage
     {
-    private:
         std::vector<std::shared_ptr<DOMnode>> nodes;
-        int nodes_counter = 0;
+        DOMnodeUID nodes_counter = 0;
+
+        // nodes are allocated in blocks, the shared_ptrs in nodes alias into
+        // the block so a node addition does not allocate the node by itself
+        std::shared_ptr<std::vector<DOMnode>> node_block;
+        static constexpr std::size_t min_node_block = 64;
+
+        // head of the intrusive free list of tombstoned nodes, the list is
+        // threaded through the parent field of the tombstones
+        DOMnodeUID vacant_head = -1;
+
+        // ancestry oracle: nested entry/exit labels and depth of every node.
+        // Labels are spread over a 62-bit range, so a node added or moved
+        // is labeled from the gap at its new place; when a gap runs out the
+        // labels go stale and are rebuilt lazily
+        std::vector<std::uint64_t> label_pre;
+        std::vector<std::uint64_t> label_post;
+        std::vector<DOMnodeUID> label_depth;
+        std::vector<std::pair<DOMnodeUID, std::list<DOMnodeUID>::const_iterator>> label_stack;
+        bool labels_valid = false;
+        std::size_t labels_walk_steps = 0; // parent-chain steps walked since the last relabeling
+        static constexpr std::uint64_t label_range = std::uint64_t(1) << 62;
+
+        // structural hash of every subtree, 0 while stale; a stale node
+        // always has stale ancestors, so invalidation stops at the first one
+        std::vector<std::uint64_t> subtree_hash;
 
-        std::queue<DOMnodeUID> vacantUIDs;
-        // DOMnode deletedNode = DOMnode("", -1, -1);
-        // std::unique_ptr<DOMnode> deletedNodeP(DOMnode("", -1, -1));
+        // numbers parsed by getInt and getDouble, by UID of the inner-data
+        // node; an entry holds while the node hashes as when it was parsed,
+        // so the hash invalidation above keeps it correct
+        struct parsed_value
+        {
+            std::uint64_t hash = 0;
+            long long integer = 0;
+            double real = 0;
+            unsigned char state = 0; // parsed_* flags
+        };
+        static constexpr unsigned char parsed_int = 1, bad_int = 2, parsed_real = 4, bad_real = 8;
+        std::vector<parsed_value> parsed_values;
+    };
 
-#define DOM_TREE_DELETED_NODE DOMnode("", -1, -1)
+    class DOMtree : private tree_storage
+    {
+        friend class DOMtreeBuilder;
+        friend class DOMfragmentBuilder;
+        friend class tree_differ;
+        friend class tree_writer;
 
+    private:
         /**
          * @brief   Gets reference to the node at the pointer in vector
          * @param   uid uid of the node
@@ -45,6 +99,15 @@ namespace dom_parser
             return *(nodes[uid].get());
         }
 
+        /**
+         * @brief   Gets const reference to the node at the pointer in vector
+         * @param   uid uid of the node
+         * */
+        inline const DOMnode &_nodes(DOMnodeUID uid) const
+        {
+            return *(nodes[uid].get());
+        }
+
         /**
         * @brief   Generates a new DOMnodeUID.
         */
@@ -52,24 +115,454 @@ namespace dom_parser
         {
             ++nodes_counter;
 
-            if (nodes_counter == 1) // added to fix a possible bug in which multiple root DOM
-                return 0;           // elements could occur if once root node is deleted.
-            if (vacantUIDs.empty())
-                return nodes_counter - 1;
+            if (vacant_head == -1)
+                return DOMnodeUID(nodes.size());
 
-            DOMnodeUID uid = vacantUIDs.front();
-            vacantUIDs.pop();
+            DOMnodeUID uid = vacant_head;
+            vacant_head = _nodes(uid).parent;
             return uid;
         }
 
+        /**
+         * @brief   Checks if another node can be added without running out
+         *          of UIDs, which happens with 32-bit UIDs past 2^31 - 1 nodes.
+         */
+        inline bool hasVacantUID()
+        {
+            return vacant_head != -1 ||
+                   nodes.size() < std::size_t(std::numeric_limits<DOMnodeUID>::max());
+        }
+
+        /**
+         * @brief   Places a node at the given UID, reusing the tombstone in that
+         *          slot if there is one, otherwise appending a new node.
+         * @param   uid     UID generated by generateUID()
+         * @param   parent  UID of the parent
+         * @return  reference to the placed node
+         * */
+        inline DOMnode &placeNode(DOMnodeUID uid, DOMnodeUID parent)
+        {
+            if (uid < nodes.size())                          // If a vacant space is filled then revive
+            {                                                // the tombstone, otherwise push_back to the
+                _nodes(uid)._revive(uid, parent);            // end of the vector. Keeps UID and position
+                return _nodes(uid);                          // in the vector consistent.
+            }
+
+            if (!node_block || node_block->size() == node_block->capacity())
+                allocateNodeBlock(std::max(min_node_block, nodes.size() / 2));
+            node_block->emplace_back("", uid, parent);
+            nodes.push_back(std::shared_ptr<DOMnode>(node_block, &node_block->back()));
+            return _nodes(uid);
+        }
+
+        /**
+         * @brief   Starts a new block of node storage. The previous block stays
+         *          alive as long as any of its nodes is referenced.
+         * @param   block_size  number of nodes the block can hold
+         * */
+        inline void allocateNodeBlock(std::size_t block_size)
+        {
+            node_block = std::make_shared<std::vector<DOMnode>>();
+            node_block->reserve(block_size);
+        }
+
+        /**
+         * @brief   Replaces the nodes shared with the tree copied from by copies
+         *          in a block of this tree, tombstones included, so UIDs and the
+         *          free list stay valid and neither tree sees the other's edits.
+         * */
+        inline void copyNodes()
+        {
+            allocateNodeBlock(std::max(min_node_block, nodes.size()));
+            for (auto &node : nodes)
+            {
+                node_block->push_back(*node);
+                node = std::shared_ptr<DOMnode>(node_block, &node_block->back());
+            }
+            label_stack.clear();
+        }
+
         /**
          * @brief   Checks existance of a node with given UID.
          * @param   node     The node UID.
          * @return  true or false accordingly
          */
-        inline bool checkNodeExistance(DOMnodeUID node)
+        inline bool checkNodeExistance(DOMnodeUID node) const
+        {
+            return (node >= 0 && node < nodes.size() && !_nodes(node).tombstone);
+        }
+
+        /**
+         * @brief   Marks the ancestry labels stale, for changes which cannot be
+         *          labeled in place. Walks charged since the last relabeling
+         *          are kept, so changes interleaved with queries still lead to
+         *          a relabeling.
+         * */
+        inline void invalidateLabels()
+        {
+            labels_valid = false;
+        }
+
+        /**
+         * @brief   Labels the nodes of a subtree in preorder, giving each an
+         *          entry and an exit label from the counter.
+         * @param   subtree_root    UID of the subtree root, its depth is set
+         * @param   counter         next label, advanced past the subtree
+         * @param   step            distance between consecutive labels
+         * */
+        void labelNodes(DOMnodeUID subtree_root, std::uint64_t &counter, std::uint64_t step)
         {
-            return (node < nodes.size() && _nodes(node).getUID() != -1);
+            label_stack.clear();
+            label_pre[subtree_root] = counter;
+            counter += step;
+            label_stack.emplace_back(subtree_root, _nodes(subtree_root).getChildrenUID().begin());
+
+            while (!label_stack.empty())
+            {
+                auto &top = label_stack.back();
+                if (top.second == _nodes(top.first).getChildrenUID().end())
+                {
+                    label_post[top.first] = counter;
+                    counter += step;
+                    label_stack.pop_back();
+                    continue;
+                }
+
+                DOMnodeUID child = *(top.second);
+                ++top.second;
+                label_pre[child] = counter;
+                counter += step;
+                label_depth[child] = label_depth[top.first] + 1;
+                label_stack.emplace_back(child, _nodes(child).getChildrenUID().begin());
+            }
+        }
+
+        /**
+         * @brief   Recomputes the labels and depths of the whole tree with an
+         *          iterative depth first traversal from the root, spacing the
+         *          labels evenly over the label range. Storage is reused
+         *          between relabelings so no allocation happens once it has grown.
+         * */
+        void relabel()
+        {
+            label_pre.resize(nodes.size());
+            label_post.resize(nodes.size());
+            label_depth.resize(nodes.size());
+
+            std::uint64_t step = std::max<std::uint64_t>(1, label_range / (2 * nodes.size() + 2));
+            std::uint64_t counter = step;
+            if (checkNodeExistance(0))
+            {
+                label_depth[0] = 0;
+                labelNodes(0, counter, step);
+            }
+
+            labels_valid = true;
+            labels_walk_steps = 0;
+        }
+
+        /**
+         * @brief   Labels a subtree just attached at its place from the gap
+         *          between the labels of its new neighbours, in time linear in
+         *          the size of the subtree, so that additions and moves keep
+         *          the labels valid. Marks the labels stale if the gap is too
+         *          narrow, which takes a few dozen insertions at the same
+         *          place after a relabeling, or if the subtree holds more than
+         *          a sixteenth of the tree.
+         * @param   subtree_root    UID of the attached node, not the root
+         * */
+        void labelSubtree(DOMnodeUID subtree_root)
+        {
+            if (!labels_valid)
+                return;
+            DOMnodeUID parent = _nodes(subtree_root).parent;
+            const std::list<DOMnodeUID> &siblings = _nodes(parent).children;
+            auto at = (!siblings.empty() && siblings.back() == subtree_root)
+                          ? std::prev(siblings.end())
+                          : std::find(siblings.begin(), siblings.end(), subtree_root);
+            if (at == siblings.end()) // not attached, under an inner-data node
+            {
+                invalidateLabels();
+                return;
+            }
+
+            if (label_pre.size() < nodes.size())
+            {
+                label_pre.resize(nodes.size());
+                label_post.resize(nodes.size());
+                label_depth.resize(nodes.size());
+            }
+            std::uint64_t low = (at == siblings.begin()) ? label_pre[parent] : label_post[*std::prev(at)];
+            std::uint64_t high = (std::next(at) == siblings.end()) ? label_post[parent] : label_pre[*std::next(at)];
+
+            // two labels per node of the subtree; counting stops at the
+            // limit, larger subtrees are left to the lazy relabeling
+            std::size_t limit = std::min<std::uint64_t>((high - low) / 2, nodes.size() / 16 + 64);
+            std::size_t size = 1;
+            if (!_nodes(subtree_root).children.empty())
+            {
+                size = 0;
+                label_stack.clear();
+                label_stack.emplace_back(subtree_root, _nodes(subtree_root).getChildrenUID().begin());
+                while (!label_stack.empty() && size <= limit)
+                {
+                    auto &top = label_stack.back();
+                    if (top.second == _nodes(top.first).getChildrenUID().end())
+                    {
+                        ++size;
+                        label_stack.pop_back();
+                        continue;
+                    }
+                    DOMnodeUID child = *(top.second);
+                    ++top.second;
+                    label_stack.emplace_back(child, _nodes(child).getChildrenUID().begin());
+                }
+            }
+
+            std::uint64_t step = (high - low) / (2 * size + 1);
+            if (size > limit || step == 0)
+            {
+                invalidateLabels();
+                return;
+            }
+            std::uint64_t counter = low + step;
+            label_depth[subtree_root] = label_depth[parent] + 1;
+            labelNodes(subtree_root, counter, step);
+        }
+
+        /**
+         * @brief   Accounts for parent-chain steps walked while labels are stale.
+         *          Once the walked steps add up to the size of the tree, the labels
+         *          are rebuilt, so relabeling is amortized against the walks it saves.
+         * @param   steps   number of steps walked by the last query
+         * */
+        inline void chargeWalk(std::size_t steps)
+        {
+            labels_walk_steps += steps;
+            if (labels_walk_steps >= nodes.size())
+                relabel();
+        }
+
+        /**
+         * @brief   Hash of a single node given the hashes of its children.
+         * */
+        std::uint64_t hashNode(const DOMnode &node) const
+        {
+            if (node.isInnerDataNode())
+                return hash_string(1, node.getInnerData());
+
+            std::uint64_t h = hash_string(2, node.getTagName());
+            h = hash_combine(h, node.getAllAttributes().size());
+            for (const auto &attribute : node.getAllAttributes()) // sorted by name
+                h = hash_string(hash_string(h, attribute.first), attribute.second);
+            h = hash_combine(h, node.getChildrenUID().size());
+            for (DOMnodeUID child : node.getChildrenUID())
+                h = hash_combine(h, subtree_hash[child]);
+            return h;
+        }
+
+        /**
+         * @brief   Recomputes the stale hashes in the subtree bottom-up with an
+         *          iterative post-order traversal, descending only into stale
+         *          subtrees.
+         * @param   subtree_root    UID of a stale node
+         * */
+        void rehash(DOMnodeUID subtree_root)
+        {
+            if (subtree_hash.size() < nodes.size())
+                subtree_hash.resize(nodes.size(), 0);
+            label_stack.clear();
+            label_stack.emplace_back(subtree_root, _nodes(subtree_root).getChildrenUID().begin());
+
+            while (!label_stack.empty())
+            {
+                auto &top = label_stack.back();
+                if (top.second == _nodes(top.first).getChildrenUID().end())
+                {
+                    std::uint64_t h = hashNode(_nodes(top.first));
+                    subtree_hash[top.first] = (h == 0) ? 1 : h; // 0 marks stale
+                    label_stack.pop_back();
+                    continue;
+                }
+
+                DOMnodeUID child = *(top.second);
+                ++top.second;
+                if (subtree_hash[child] == 0)
+                    label_stack.emplace_back(child, _nodes(child).getChildrenUID().begin());
+            }
+        }
+
+        /**
+         * @brief   UID of the inner-data node holding the text of a node: the
+         *          node itself, or the only child of an element. -1 if none.
+         * */
+        DOMnodeUID textNode(DOMnodeUID node)
+        {
+            if (!checkNodeExistance(node))
+                return -1;
+            const DOMnode &element = _nodes(node);
+            if (element.innerDataNode)
+                return node;
+            if (element.children.size() != 1)
+                return -1;
+            DOMnodeUID child = element.children.front();
+            return _nodes(child).innerDataNode ? child : -1;
+        }
+
+        /**
+         * @brief   Reads the text of a node as a number, parsing it only if it
+         *          changed since the last read, see getInt.
+         * */
+        template <typename T>
+        int parsedValue(DOMnodeUID node, T &value)
+        {
+            constexpr bool real = std::is_same_v<T, double>;
+            constexpr unsigned char parsed = real ? parsed_real : parsed_int;
+            constexpr unsigned char bad = real ? bad_real : bad_int;
+
+            DOMnodeUID text = textNode(node);
+            if (text == -1)
+                return -1;
+            if (parsed_values.size() <= std::size_t(text))
+                parsed_values.resize(nodes.size());
+            parsed_value &slot = parsed_values[text];
+            if (std::size_t(text) >= subtree_hash.size() || subtree_hash[text] == 0 ||
+                subtree_hash[text] != slot.hash)
+            {
+                slot.hash = getSubtreeHash(text);
+                slot.state = 0;
+            }
+
+            if ((slot.state & (parsed | bad)) == 0)
+            {
+                T number;
+                if (!parse_value(_nodes(text).innerData, number))
+                    slot.state |= bad;
+                else
+                {
+                    slot.state |= parsed;
+                    if constexpr (real)
+                        slot.real = number;
+                    else
+                        slot.integer = number;
+                }
+            }
+            if (slot.state & bad)
+                return -2;
+            if constexpr (real)
+                value = slot.real;
+            else
+                value = slot.integer;
+            return 0;
+        }
+
+        /**
+         * @brief   Places a node as a child of parent: after the given child,
+         *          first for -1, last for -2.
+         * */
+        inline void attachChild(DOMnodeUID parent, DOMnodeUID child, DOMnodeUID after)
+        {
+            if (after == -2)
+                _nodes(parent).addChild(child);
+            else
+                _nodes(parent).addChild(child, after);
+        }
+
+        /**
+         * @brief   Moves a subtree under a new parent, see moveSubtree. The moved
+         *          nodes are labeled at their new place, so moves interleaved
+         *          with isAncestor keep answering from the labels.
+         * @param   after   child of the new parent to follow, -1 for the first
+         *                  place, -2 for the last place
+         * */
+        bool relink(DOMnodeUID subtree_root, DOMnodeUID new_parent, DOMnodeUID after)
+        {
+            if (!checkNodeExistance(subtree_root) || !checkNodeExistance(new_parent))
+                return false;
+            if (subtree_root == 0)
+                return false;
+            if (subtree_root == new_parent)
+                return false;
+
+            if (isAncestor(subtree_root, new_parent))
+                return false;
+
+            DOMnodeUID old_parent = _nodes(subtree_root).getParent();
+            _nodes(old_parent).removeChild(subtree_root);
+            attachChild(new_parent, subtree_root, after);
+            _nodes(subtree_root).setParent(new_parent);
+            labelSubtree(subtree_root);
+            invalidateHash(old_parent);
+            invalidateHash(new_parent);
+            return true;
+        }
+
+        /**
+         * @brief   Copies or moves the subtree of another tree, see graftSubtree.
+         * */
+        template <bool move, typename Source>
+        DOMnodeUID graft(Source &source, DOMnodeUID source_root, DOMnodeUID parent, DOMnodeUID after,
+                         std::vector<DOMnodeUID> *remap)
+        {
+            if (static_cast<const DOMtree *>(&source) == this || !source.checkNodeExistance(source_root) ||
+                !checkNodeExistance(parent) || _nodes(parent).innerDataNode)
+                return -1;
+
+            std::vector<DOMnodeUID> local;
+            std::vector<DOMnodeUID> &new_uid = remap != nullptr ? *remap : local;
+            if (new_uid.size() < source.nodes.size())
+                new_uid.resize(source.nodes.size(), -1);
+
+            // one preorder pass: a parent is always placed before its
+            // children, which are appended in order
+            std::vector<DOMnodeUID> pending(1, source_root);
+            while (!pending.empty())
+            {
+                DOMnodeUID from = pending.back();
+                pending.pop_back();
+                if (!hasVacantUID())
+                {
+                    // out of UIDs, undo what was placed so far
+                    if (new_uid[source_root] != -1)
+                        deleteSubtree(new_uid[source_root]);
+                    return -1;
+                }
+
+                auto &node = source._nodes(from);
+                DOMnodeUID to_parent = (from == source_root) ? parent : new_uid[node.parent];
+                DOMnodeUID uid = generateUID();
+                DOMnode &copy = placeNode(uid, to_parent);
+                new_uid[from] = uid;
+                if (std::size_t(uid) < subtree_hash.size())
+                    subtree_hash[uid] = 0;
+
+                copy.innerDataNode = node.innerDataNode;
+                if constexpr (move)
+                {
+                    copy.tagName = std::move(node.tagName);
+                    copy.innerData = std::move(node.innerData);
+                    copy.tagAttributes = std::move(node.tagAttributes);
+                }
+                else
+                {
+                    copy.tagName = node.tagName;
+                    copy.innerData = node.innerData;
+                    copy.tagAttributes = node.tagAttributes;
+                }
+
+                if (from == source_root)
+                    attachChild(parent, uid, after);
+                else
+                    _nodes(to_parent).children.push_back(uid);
+
+                const auto &children = node.getChildrenUID();
+                for (auto child = children.rbegin(); child != children.rend(); ++child)
+                    pending.push_back(*child);
+            }
+
+            invalidateLabels();
+            invalidateHash(parent);
+            return new_uid[source_root];
         }
 
     public:
@@ -80,15 +573,69 @@ namespace dom_parser
          */
         DOMtree() {}
 
+        DOMtree(const DOMtree &tree)
+            : tree_storage(tree)
+        {
+            copyNodes();
+        }
+        DOMtree(DOMtree &&tree) noexcept
+            : tree_storage(std::move(tree))
+        {
+            static_cast<tree_storage &>(tree) = tree_storage();
+        }
+
         /**
          * @brief   Constructor of the tree with an initial root node.
          * @param   rootName    Name of the root node.
          */
         DOMtree(std::string root)
         {
-            nodes.push_back(
-                std::shared_ptr<DOMnode>(
-                    new DOMnode(root, generateUID(), -1))); // root
+            placeNode(generateUID(), -1).tagName = std::move(root); // root
+        }
+
+        /**
+         * @brief   Removes all the nodes but keeps their storage. Nodes added
+         *          afterwards reuse it and get UIDs from 0 upwards as in a new
+         *          tree.
+         */
+        void clear()
+        {
+            vacant_head = -1; // every slot is buried below, tombstones included
+            for (DOMnodeUID uid = DOMnodeUID(nodes.size()) - 1; uid >= 0; --uid)
+            {
+                _nodes(uid)._bury(vacant_head);
+                vacant_head = uid;
+            }
+            nodes_counter = 0;
+            invalidateLabels();
+            subtree_hash.clear();
+            parsed_values.clear();
+        }
+
+        /**
+         * @brief   Removes all the nodes but keeps their storage, and adds a
+         *          new root node.
+         * @param   root    Name of the root node.
+         */
+        void clear(std::string root)
+        {
+            clear();
+            placeNode(generateUID(), -1).tagName = std::move(root); // root
+        }
+
+        /**
+         * @brief   Preallocates storage for the given number of nodes so that
+         *          the following additions neither grow the node vector nor
+         *          allocate node blocks.
+         * @param   node_count  total number of nodes expected in the tree
+         */
+        void reserve(std::size_t node_count)
+        {
+            if (node_count <= nodes.size())
+                return;
+            nodes.reserve(node_count);
+            if (!node_block || node_block->capacity() - node_block->size() < node_count - nodes.size())
+                allocateNodeBlock(node_count - nodes.size());
         }
 
         /**
@@ -96,22 +643,19 @@ namespace dom_parser
          * @param   parent   Parent node UID.
          * @param   tagName  Tag name of the node.
          * @return  DOMnodeID   if node added succefully
-         *          -1          if parent does not exist
+         *          -1          if parent does not exist or UIDs ran out
          */
         DOMnodeUID addNode(DOMnodeUID parent, std::string tagName)
         {
-            if (!checkNodeExistance(parent))
+            if (!checkNodeExistance(parent) || !hasVacantUID())
                 return -1;
 
             DOMnodeUID UID = generateUID();
-            std::shared_ptr<DOMnode> node(new DOMnode(tagName, UID, parent));
-
-            if (UID < nodes.size())                      // If a vacant space if filled then use [] operator
-                nodes[UID] = std::move(node);            // otherwise push_back to the end of the vector.
-            else                                         // Condition added to make sure that UID and iterator
-                nodes.push_back(std::move(node));        // position is consistent.
+            placeNode(UID, parent).tagName = std::move(tagName);
 
             _nodes(parent).addChild(UID);
+            labelSubtree(UID);
+            invalidateHash(UID);
 
             return UID;
         }
@@ -121,26 +665,75 @@ namespace dom_parser
          * @param   parent   Parent node UID.
          * @param   data     inner-data
          * @return  DOMnodeID   if node added succefully
-         *          -1          if parent does not exist
+         *          -1          if parent does not exist or UIDs ran out
          */
         DOMnodeUID addInnerDataNode(DOMnodeUID parent, std::string data)
         {
-            if (!checkNodeExistance(parent))
+            if (!checkNodeExistance(parent) || !hasVacantUID())
                 return -1;
 
             DOMnodeUID UID = generateUID();
-            std::shared_ptr<DOMnode> node(new DOMnode(UID, parent, data));
-
-            if (UID < nodes.size())                      // If a vacant space if filled then use [] operator
-                nodes[UID] = std::move(node);            // otherwise push_back to the end of the vector.
-            else                                         // Condition added to make sure that UID and iterator
-                nodes.push_back(std::move(node));        // position is consistent.
+            DOMnode &node = placeNode(UID, parent);
+            node.innerDataNode = true;
+            node.innerData = std::move(data);
 
             _nodes(parent).addChild(UID);
+            labelSubtree(UID);
+            invalidateHash(UID);
 
             return UID;
         }
 
+        /**
+         * @brief   Adds a node within the tree at a given place among the
+         *          children of its parent.
+         * @param   parent   Parent node UID.
+         * @param   tagName  Tag name of the node.
+         * @param   after    Child of the parent to follow, -1 for the first place.
+         * @return  DOMnodeID   if node added succefully
+         *          -1          if parent does not exist or UIDs ran out
+         */
+        DOMnodeUID addNode(DOMnodeUID parent, std::string tagName, DOMnodeUID after)
+        {
+            DOMnodeUID UID = addNode(parent, std::move(tagName));
+            if (UID != -1 && !_nodes(parent).innerDataNode)
+            {
+                _nodes(parent).children.pop_back(); // appended by addNode
+                _nodes(parent).addChild(UID, after);
+                labelSubtree(UID);
+            }
+            return UID;
+        }
+
+        /**
+         * @brief   Adds a inner-data node at a given place among the children
+         *          of its parent.
+         * @param   parent   Parent node UID.
+         * @param   data     inner-data
+         * @param   after    Child of the parent to follow, -1 for the first place.
+         * @return  DOMnodeID   if node added succefully
+         *          -1          if parent does not exist or UIDs ran out
+         */
+        DOMnodeUID addInnerDataNode(DOMnodeUID parent, std::string data, DOMnodeUID after)
+        {
+            DOMnodeUID UID = addInnerDataNode(parent, std::move(data));
+            if (UID != -1 && !_nodes(parent).innerDataNode)
+            {
+                _nodes(parent).children.pop_back(); // appended by addNode
+                _nodes(parent).addChild(UID, after);
+                labelSubtree(UID);
+            }
+            return UID;
+        }
+
+        /**
+         * @brief   Returns the number of nodes in the tree.
+         */
+        inline DOMnodeUID getNodeCount() const
+        {
+            return nodes_counter;
+        }
+
         /**
          * @brief   Returns a reference to the node with given UID.
          * @param   node    UID of the node.
@@ -150,6 +743,15 @@ namespace dom_parser
             return _nodes(node);
         }
 
+        /**
+         * @brief   Returns a const reference to the node with given UID.
+         * @param   node    UID of the node.
+         */
+        inline const DOMnode &getNode(DOMnodeUID node) const
+        {
+            return _nodes(node);
+        }
+
         /**
          * @brief   Moves a whole subtree from one parent node to another.
          * @param   subtree_root     Subtree root node UID.
@@ -159,28 +761,67 @@ namespace dom_parser
          */
         bool moveSubtree(DOMnodeUID subtree_root, DOMnodeUID new_parent)
         {
-            if (!checkNodeExistance(subtree_root) || !checkNodeExistance(new_parent))
-                return false;
-            if (subtree_root == 0)
-                return false;
-            if (subtree_root == new_parent)
+            return relink(subtree_root, new_parent, -2);
+        }
+
+        /**
+         * @brief   Moves a whole subtree to a given place among the children
+         *          of a node, which may be its current parent.
+         * @param   subtree_root     Subtree root node UID.
+         * @param   new_parent       New parent node of the subtree.
+         * @param   after            Child of the new parent to follow, -1 for
+         *                           the first place.
+         * @return  true    if moving is successful
+         *          false   if moving is unsuccessful due to problem in input.
+         */
+        bool moveSubtree(DOMnodeUID subtree_root, DOMnodeUID new_parent, DOMnodeUID after)
+        {
+            if (after == subtree_root || !checkNodeExistance(new_parent) || _nodes(new_parent).innerDataNode)
                 return false;
+            return relink(subtree_root, new_parent, after);
+        }
 
-            std::vector<DOMnodeUID> ancestors = getAncestorList(new_parent);
-            for (DOMnodeUID ancestor : ancestors)
-                if (ancestor == subtree_root)
-                    return false;
+        /**
+         * @brief   Copies a subtree of another tree under a node of this tree.
+         *          Nodes get UIDs of this tree in a single preorder pass over
+         *          the source, without going through addNode.
+         * @param   source          Tree holding the subtree, not this tree.
+         * @param   source_root     Root of the subtree in the source tree.
+         * @param   parent          New parent node of the copy.
+         * @param   after           Child of the parent to follow, -1 for the first
+         *                          place, -2 for the last place.
+         * @param   remap           If not nullptr, receives the new UID of every
+         *                          node of the subtree at its source UID. It is
+         *                          grown to the size of the source with -1, other
+         *                          entries are kept, so it can collect the result
+         *                          of several grafts from the same source.
+         * @return  UID of the copied root
+         *          -1  if a node does not exist, parent stores inner data or
+         *              UIDs ran out
+         */
+        DOMnodeUID graftSubtree(const DOMtree &source, DOMnodeUID source_root, DOMnodeUID parent,
+                                DOMnodeUID after = -2, std::vector<DOMnodeUID> *remap = nullptr)
+        {
+            return graft<false>(source, source_root, parent, after, remap);
+        }
 
-            DOMnodeUID old_parent = _nodes(subtree_root).getParent();
-            _nodes(old_parent).removeChild(subtree_root);
-            _nodes(new_parent).addChild(subtree_root);
-            _nodes(subtree_root).setParent(new_parent);
-            return true;
+        /**
+         * @brief   Moves a subtree of another tree under a node of this tree,
+         *          see the copying overload. Names, data and attributes of the
+         *          grafted nodes are moved out of the source, which is left
+         *          with the emptied nodes and should be discarded.
+         */
+        DOMnodeUID graftSubtree(DOMtree &&source, DOMnodeUID source_root, DOMnodeUID parent,
+                                DOMnodeUID after = -2, std::vector<DOMnodeUID> *remap = nullptr)
+        {
+            return graft<true>(source, source_root, parent, after, remap);
         }
 
         /**
          * @brief   Deletes the subtree with the given node as root.
          *          Deletes the single node if no child nodes present.
+         *          Deleted nodes are turned into tombstones and their UIDs
+         *          are reused by later additions.
          * @param   subtree_root Subtree root node.
          */
         void deleteSubtree(DOMnodeUID subtree_root)
@@ -188,22 +829,169 @@ namespace dom_parser
             if (!checkNodeExistance(subtree_root))
                 return;
 
-            DOMnodeUID current_node; // = subtree_root;
-            std::queue<DOMnodeUID> node_queue;
-            node_queue.push(subtree_root);
+            DOMnodeUID parent = _nodes(subtree_root).getParent();
+            if (parent != -1)
+            {
+                _nodes(parent).removeChild(subtree_root);
+                invalidateHash(parent);
+            }
 
-            while (!node_queue.empty())
+            // nodes waiting to be deleted are chained through their parent
+            // field, which is not needed anymore, so no queue is allocated
+            DOMnodeUID pending = subtree_root;
+            _nodes(subtree_root).parent = -1;
+
+            while (pending != -1)
             {
-                current_node = node_queue.front();
+                DOMnodeUID current_node = pending;
+                DOMnode &node = _nodes(current_node);
+                pending = node.parent;
 
-                for (DOMnodeUID node : _nodes(current_node).getChildrenUID())
-                    node_queue.push(node);
-                node_queue.pop();
+                for (DOMnodeUID child : node.getChildrenUID())
+                {
+                    _nodes(child).parent = pending;
+                    pending = child;
+                }
 
-                vacantUIDs.push(current_node);
-                nodes[current_node] = std::shared_ptr<DOMnode>(new DOM_TREE_DELETED_NODE);
+                node._bury(vacant_head);
+                vacant_head = current_node;
                 nodes_counter--;
             }
+            // the labels of the remaining nodes stay nested, revived UIDs
+            // are labeled again when added
+        }
+
+        /**
+         * @brief   Moves the live nodes in document order into one new block of
+         *          storage and frees the old blocks with their tombstones, so
+         *          traversals walk memory in order again after many deletions.
+         *          The nodes are renumbered accordingly, every UID held outside
+         *          the tree is invalidated.
+         * @return  std::vector mapping old UIDs to new UIDs, -1 for deleted nodes.
+         */
+        std::vector<DOMnodeUID> compact()
+        {
+            std::vector<DOMnodeUID> new_uid(nodes.size(), -1);
+            if (!checkNodeExistance(0))
+            {
+                nodes.clear();
+                node_block.reset();
+                vacant_head = -1;
+                nodes_counter = 0;
+                invalidateLabels();
+                subtree_hash.clear();
+                parsed_values.clear();
+                return new_uid;
+            }
+
+            // number the nodes in pre-order
+            DOMnodeUID counter = 0;
+            std::vector<DOMnodeUID> old_uid;
+            old_uid.reserve(nodes_counter);
+            label_stack.clear();
+            old_uid.push_back(0);
+            new_uid[0] = counter++;
+            label_stack.emplace_back(0, _nodes(0).getChildrenUID().begin());
+            while (!label_stack.empty())
+            {
+                auto &top = label_stack.back();
+                if (top.second == _nodes(top.first).getChildrenUID().end())
+                {
+                    label_stack.pop_back();
+                    continue;
+                }
+                DOMnodeUID child = *(top.second);
+                ++top.second;
+                old_uid.push_back(child);
+                new_uid[child] = counter++;
+                label_stack.emplace_back(child, _nodes(child).getChildrenUID().begin());
+            }
+
+            // move the live nodes in pre-order into a new block and rewrite
+            // the links, the old blocks are freed with the old pointers
+            std::vector<std::shared_ptr<DOMnode>> compacted;
+            compacted.reserve(counter);
+            allocateNodeBlock(std::max(min_node_block, std::size_t(counter)));
+            for (DOMnodeUID uid = 0; uid < counter; ++uid)
+            {
+                node_block->push_back(std::move(_nodes(old_uid[uid])));
+                DOMnode &node = node_block->back();
+                node.uid = uid;
+                if (node.parent != -1)
+                    node.parent = new_uid[node.parent];
+                for (DOMnodeUID &child : node.children)
+                    child = new_uid[child];
+                compacted.push_back(std::shared_ptr<DOMnode>(node_block, &node));
+            }
+
+            nodes.swap(compacted);
+            compacted.clear();
+            vacant_head = -1;
+            nodes_counter = counter;
+            invalidateLabels();
+            subtree_hash.clear();
+            parsed_values.clear();
+            return new_uid;
+        }
+
+        /**
+         * @brief   Checks if a node is a proper ancestor of another node. Answers
+         *          in O(1) from interval labels, which additions, moves and
+         *          deletions keep up to date; after other structural changes
+         *          it walks the parent chain without allocating until the
+         *          labels are rebuilt.
+         * @param   ancestor    UID of the supposed ancestor.
+         * @param   node        UID of the node.
+         * @return  true    if ancestor lies on the path from root to node
+         *          false   otherwise, or if either node does not exist
+         */
+        bool isAncestor(DOMnodeUID ancestor, DOMnodeUID node)
+        {
+            if (!checkNodeExistance(ancestor) || !checkNodeExistance(node) || ancestor == node)
+                return false;
+
+            if (labels_valid)
+                return label_pre[ancestor] < label_pre[node] &&
+                       label_post[node] < label_post[ancestor];
+
+            std::size_t steps = 0;
+            bool found = false;
+            DOMnodeUID node_uid = node;
+            while (node_uid != 0)
+            {
+                node_uid = _nodes(node_uid).getParent();
+                ++steps;
+                if (node_uid == ancestor)
+                {
+                    found = true;
+                    break;
+                }
+            }
+            chargeWalk(steps);
+            return found;
+        }
+
+        /**
+         * @brief   Returns the depth of the node, root being at depth 0.
+         *          Returns -1 if the node does not exist.
+         * @param   node     The node UID.
+         */
+        DOMnodeUID getDepth(DOMnodeUID node)
+        {
+            if (!checkNodeExistance(node))
+                return -1;
+            if (labels_valid)
+                return label_depth[node];
+
+            DOMnodeUID depth = 0;
+            DOMnodeUID node_uid = node;
+            while (node_uid != 0)
+            {
+                node_uid = _nodes(node_uid).getParent();
+                ++depth;
+            }
+            chargeWalk(depth);
+            return depth;
         }
 
         /**
@@ -223,13 +1011,190 @@ namespace dom_parser
         }
 
         /**
-         * @brief   Operator overload for =
+         * @brief   Sets an attribute of a node and invalidates the cached
+         *          hashes depending on it.
+         * @param   node        UID of the node
+         * @param   attribute   name of the attribute
+         * @param   value       value of the attribute
+         * @return  false if the node does not exist
+         */
+        bool setAttribute(DOMnodeUID node, std::string_view attribute, std::string_view value)
+        {
+            if (!checkNodeExistance(node))
+                return false;
+            _nodes(node).setAttribute(attribute, value);
+            invalidateHash(node);
+            return true;
+        }
+
+        /**
+         * @brief   Removes an attribute of a node.
+         * @param   node        UID of the node
+         * @param   attribute   name of the attribute
+         * @return  false if the node or the attribute does not exist
+         */
+        bool removeAttribute(DOMnodeUID node, std::string_view attribute)
+        {
+            if (!checkNodeExistance(node) || !_nodes(node).removeAttribute(attribute))
+                return false;
+            invalidateHash(node);
+            return true;
+        }
+
+        /**
+         * @brief   Renames a node.
+         * @param   node        UID of the node, not an inner-data node
+         * @param   tagName     new tag name
+         * @return  false if the node does not exist or stores inner data
+         */
+        bool setTagName(DOMnodeUID node, std::string tagName)
+        {
+            if (!checkNodeExistance(node) || _nodes(node).innerDataNode)
+                return false;
+            _nodes(node).tagName = std::move(tagName);
+            invalidateHash(node);
+            return true;
+        }
+
+        /**
+         * @brief   Replaces the data of an inner-data node.
+         * @param   node    UID of the inner-data node
+         * @param   data    new inner-data
+         * @return  false if the node does not exist or is not an inner-data node
+         */
+        bool setInnerData(DOMnodeUID node, std::string data)
+        {
+            if (!checkNodeExistance(node) || !_nodes(node).innerDataNode)
+                return false;
+            _nodes(node).innerData = std::move(data);
+            invalidateHash(node);
+            return true;
+        }
+
+        /**
+         * @brief   Marks the cached hash of the node and of its ancestors stale.
+         *          Called by the mutations of the tree; call it after changing a
+         *          node directly through getNode().
+         * @param   node    UID of the changed node
+         */
+        void invalidateHash(DOMnodeUID node)
+        {
+            if (node < 0 || std::size_t(node) >= subtree_hash.size())
+            {
+                // not hashed yet, its ancestors may be
+                if (node < 0 || !checkNodeExistance(node))
+                    return;
+                node = _nodes(node).getParent();
+                if (node == -1 || std::size_t(node) >= subtree_hash.size())
+                    return;
+            }
+            subtree_hash[node] = 0;
+            for (node = _nodes(node).getParent(); node != -1 && subtree_hash[node] != 0;
+                 node = _nodes(node).getParent())
+                subtree_hash[node] = 0;
+        }
+
+        /**
+         * @brief   Returns the structural hash of the subtree: tag names, sorted
+         *          attributes, inner data and the order of children, but not the
+         *          UIDs. Equal subtrees hash equal in any tree. Hashes are cached;
+         *          the first call hashes the whole subtree in one bottom-up pass,
+         *          later calls only rehash what changed since.
+         * @param   node    UID of the subtree root
+         * @return  the hash, 0 if the node does not exist
+         */
+        std::uint64_t getSubtreeHash(DOMnodeUID node)
+        {
+            if (!checkNodeExistance(node))
+                return 0;
+            if (std::size_t(node) >= subtree_hash.size() || subtree_hash[node] == 0)
+                rehash(node);
+            return subtree_hash[node];
+        }
+
+        /**
+         * @brief   Reads the text of a node as an integer: the data of an
+         *          inner-data node, or of the only child of an element such as
+         *          <quantity>3</quantity>. The number is parsed on the first
+         *          read and kept until the text changes, so later passes over
+         *          the same nodes do not parse the strings again.
+         * @param   node    UID of the node
+         * @param   value   set to the integer, untouched on failure
+         * @return  0 if read, -1 if the node does not exist or does not hold a
+         *          single text, -2 if the text is not an integer
+         */
+        inline int getInt(DOMnodeUID node, long long &value)
+        {
+            return parsedValue(node, value);
+        }
+
+        /**
+         * @brief   Reads the text of a node as a floating point number, parsed
+         *          once like getInt.
+         * @param   node    UID of the node
+         * @param   value   set to the number, untouched on failure
+         * @return  0 if read, -1 if the node does not exist or does not hold a
+         *          single text, -2 if the text is not a number
+         */
+        inline int getDouble(DOMnodeUID node, double &value)
+        {
+            return parsedValue(node, value);
+        }
+
+        /**
+         * @brief   Reads the text of a node as a boolean: true, false, 1 or 0.
+         * @param   node    UID of the node
+         * @param   value   set to the boolean, untouched on failure
+         * @return  0 if read, -1 if the node does not exist or does not hold a
+         *          single text, -2 if the text is not a boolean
+         */
+        int getBool(DOMnodeUID node, bool &value)
+        {
+            DOMnodeUID text = textNode(node);
+            if (text == -1)
+                return -1;
+            return parse_value(_nodes(text).innerData, value) ? 0 : -2;
+        }
+
+        /**
+         * @brief   Checks if two subtrees, possibly of different trees, are equal
+         *          by comparing their hashes, in O(1) once hashes are cached.
+         *          Different subtrees compare equal only on a 64-bit collision.
+         * @param   node        UID of the subtree root in this tree
+         * @param   other       tree of the other subtree, may be this tree
+         * @param   other_node  UID of the other subtree root
+         */
+        inline bool isSubtreeEqual(DOMnodeUID node, DOMtree &other, DOMnodeUID other_node)
+        {
+            std::uint64_t h = getSubtreeHash(node);
+            return h != 0 && h == other.getSubtreeHash(other_node);
+        }
+
+        /**
+         * @brief   Move assignment, takes over the storage of the other tree,
+         *          which is left empty and can be used again.
+         * */
+        DOMtree &operator=(DOMtree &&tree) noexcept
+        {
+            if (this == &tree)
+                return *this;
+
+            tree_storage::operator=(std::move(tree));
+            static_cast<tree_storage &>(tree) = tree_storage();
+
+            return *this;
+        }
+
+        /**
+         * @brief   Copy assignment, the copy gets nodes of its own.
          * */
         DOMtree &operator=(const DOMtree &tree)
         {
-            this->nodes = tree.nodes;
-            this->nodes_counter = tree.nodes_counter;
-            this->vacantUIDs = tree.vacantUIDs;
+            if (this == &tree)
+                return *this;
+
+            tree_storage::operator=(tree);
+            copyNodes();
 
             return *this;
         }
@@ -237,5 +1202,4 @@ namespace dom_parser
 
 } // namespace dom_parser
 
-#undef DOM_TREE_DELETED_NODE
 #endif
@@ -0,0 +1,322 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_TREE_BUILDER
+#define DOM_PARSER_DOM_TREE_BUILDER
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "DOMtree.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Stores a name or text passed to a builder in a node string. A
+     *          std::string rvalue is moved in, anything else is assigned, so
+     *          the string keeps the capacity it had in a cleared tree.
+     * */
+    template <typename Text>
+    inline void assign_text(std::string &to, Text &&text)
+    {
+        if constexpr (std::is_same_v<std::decay_t<Text>, std::string> && !std::is_lvalue_reference_v<Text>)
+            to = std::move(text);
+        else
+            to.assign(text);
+    }
+
+    /**
+     *  @brief  Streaming builder which appends nodes to a fresh DOMtree in
+     *          document order. Calls are not validated: open() must be called
+     *          first for the root, attr() applies to the innermost open element,
+     *          text() must be inside an open element and every close() must
+     *          match an open().
+     *
+     *          Names and values may be passed as std::string rvalues (moved in),
+     *          std::string_view, const char * or std::string lvalues (copied).
+     * */
+    class DOMtreeBuilder
+    {
+    private:
+        DOMtree tree;
+        std::vector<DOMnodeUID> open_elements;
+
+        /**
+         *  @brief  Appends a node under the parent without any checks.
+         *  @param  parent  UID of the parent, -1 for the root
+         * */
+        inline DOMnode &append(DOMnodeUID parent)
+        {
+            DOMnodeUID uid = tree.generateUID(); // in order, also on a cleared tree
+            DOMnode &node = tree.placeNode(uid, parent);
+            if (parent != -1)
+                tree._nodes(parent).children.push_back(uid);
+            return node;
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  expected_nodes  number of nodes to preallocate storage for
+         *  @param  expected_depth  nesting depth to preallocate the open element
+         *                          stack for
+         * */
+        DOMtreeBuilder(std::size_t expected_nodes = 0, std::size_t expected_depth = 64)
+        {
+            tree.reserve(expected_nodes);
+            open_elements.reserve(expected_depth);
+        }
+
+        /**
+         *  @brief  Opens a new element under the innermost open element, or
+         *          the root element if nothing has been opened yet.
+         *  @param  name    tag name of the element
+         * */
+        template <typename Name>
+        inline DOMtreeBuilder &open(Name &&name)
+        {
+            DOMnodeUID parent = open_elements.empty() ? -1 : open_elements.back();
+            DOMnode &node = append(parent);
+            assign_text(node.tagName, std::forward<Name>(name));
+            open_elements.push_back(node.uid);
+            return *this;
+        }
+
+        /**
+         *  @brief  Sets an attribute on the innermost open element.
+         *  @param  attribute   name of the attribute
+         *  @param  value       value of the attribute
+         * */
+        template <typename Key, typename Value>
+        inline DOMtreeBuilder &attr(Key &&attribute, Value &&value)
+        {
+            tree._nodes(open_elements.back()).tagAttributes.insert_or_assign(
+                std::string(std::forward<Key>(attribute)),
+                std::string(std::forward<Value>(value)));
+            return *this;
+        }
+
+        /**
+         *  @brief  Adds an inner-data node to the innermost open element.
+         *  @param  data    the inner text
+         * */
+        template <typename Data>
+        inline DOMtreeBuilder &text(Data &&data)
+        {
+            DOMnode &node = append(open_elements.back());
+            node.innerDataNode = true;
+            assign_text(node.innerData, std::forward<Data>(data));
+            return *this;
+        }
+
+        /**
+         *  @brief  Closes the innermost open element.
+         * */
+        inline DOMtreeBuilder &close()
+        {
+            open_elements.pop_back();
+            return *this;
+        }
+
+        /**
+         *  @brief  Returns the number of elements which are still open.
+         * */
+        inline std::size_t depth()
+        {
+            return open_elements.size();
+        }
+
+        /**
+         *  @brief  Takes over the storage of a tree no longer needed, the next
+         *          document is built into it.
+         *  @param  storage     tree whose nodes are reused
+         * */
+        void reuse(DOMtree &&storage)
+        {
+            tree = std::move(storage);
+            tree.clear();
+            open_elements.clear();
+        }
+
+        /**
+         *  @brief  Hands over the built tree and leaves the builder empty,
+         *          ready to build another document.
+         * */
+        DOMtree release()
+        {
+            DOMtree built(std::move(tree));
+            tree = DOMtree();
+            open_elements.clear();
+            built.invalidateLabels();
+            return built;
+        }
+    };
+
+    /**
+     *  @brief  Streaming builder which adds nodes under a node of an existing
+     *          tree, for parsing a fragment straight into it. Takes the same
+     *          calls as DOMtreeBuilder, except that any number of elements and
+     *          inner-data nodes may be added at the top level; they are placed
+     *          in order among the children of the parent. finish() must be
+     *          called once all are added, or rollback() to remove them again.
+     * */
+    class DOMfragmentBuilder
+    {
+    private:
+        DOMtree &tree;
+        DOMnodeUID parent;
+        DOMnodeUID after;
+        std::vector<DOMnodeUID> open_elements;
+        std::vector<DOMnodeUID> added; // top level nodes, in order
+
+        /**
+         *  @brief  Appends a node under the innermost open element, or places
+         *          it among the children of the parent at the top level.
+         * */
+        inline DOMnode &append()
+        {
+            DOMnodeUID uid = tree.generateUID();
+            if (std::size_t(uid) < tree.subtree_hash.size())
+                tree.subtree_hash[uid] = 0; // may hold the hash of a deleted node
+            if (open_elements.empty())
+            {
+                DOMnode &node = tree.placeNode(uid, parent);
+                tree.attachChild(parent, uid, added.empty() ? after : added.back());
+                added.push_back(uid);
+                return node;
+            }
+            DOMnode &node = tree.placeNode(uid, open_elements.back());
+            tree._nodes(open_elements.back()).children.push_back(uid);
+            return node;
+        }
+
+    public:
+        /**
+         *  @brief  Constructor
+         *  @param  tree    tree receiving the nodes
+         *  @param  parent  existing element the nodes are added under
+         *  @param  after   child of the parent to follow, -1 for the first
+         *                  place, -2 for the last place
+         * */
+        DOMfragmentBuilder(DOMtree &tree, DOMnodeUID parent, DOMnodeUID after = -2)
+            : tree(tree), parent(parent), after(after)
+        {
+        }
+
+        /**
+         *  @brief  Checks that the parent exists and is an element.
+         * */
+        inline bool valid() const
+        {
+            return tree.checkNodeExistance(parent) && !tree._nodes(parent).innerDataNode;
+        }
+
+        /**
+         *  @brief  Opens a new element under the innermost open element, or
+         *          under the parent if nothing is open.
+         *  @param  name    tag name of the element
+         * */
+        template <typename Name>
+        inline DOMfragmentBuilder &open(Name &&name)
+        {
+            DOMnode &node = append();
+            assign_text(node.tagName, std::forward<Name>(name));
+            open_elements.push_back(node.uid);
+            return *this;
+        }
+
+        /**
+         *  @brief  Sets an attribute on the innermost open element.
+         *  @param  attribute   name of the attribute
+         *  @param  value       value of the attribute
+         * */
+        template <typename Key, typename Value>
+        inline DOMfragmentBuilder &attr(Key &&attribute, Value &&value)
+        {
+            tree._nodes(open_elements.back()).tagAttributes.insert_or_assign(
+                std::string(std::forward<Key>(attribute)),
+                std::string(std::forward<Value>(value)));
+            return *this;
+        }
+
+        /**
+         *  @brief  Adds an inner-data node to the innermost open element, or
+         *          under the parent if nothing is open.
+         *  @param  data    the inner text
+         * */
+        template <typename Data>
+        inline DOMfragmentBuilder &text(Data &&data)
+        {
+            DOMnode &node = append();
+            node.innerDataNode = true;
+            assign_text(node.innerData, std::forward<Data>(data));
+            return *this;
+        }
+
+        /**
+         *  @brief  Closes the innermost open element.
+         * */
+        inline DOMfragmentBuilder &close()
+        {
+            open_elements.pop_back();
+            return *this;
+        }
+
+        /**
+         *  @brief  Returns the number of elements which are still open.
+         * */
+        inline std::size_t depth()
+        {
+            return open_elements.size();
+        }
+
+        /**
+         *  @brief  Returns the UIDs of the nodes added at the top level.
+         * */
+        inline const std::vector<DOMnodeUID> &getAdded()
+        {
+            return added;
+        }
+
+        /**
+         *  @brief  Marks the cached ancestry labels and hashes of the tree
+         *          stale after the additions.
+         * */
+        void finish()
+        {
+            open_elements.clear();
+            tree.invalidateHash(parent);
+            tree.invalidateLabels();
+        }
+
+        /**
+         *  @brief  Removes every node added so far, leaving the tree as it was
+         *          apart from the UIDs, which are reused by later additions.
+         * */
+        void rollback()
+        {
+            open_elements.clear();
+            for (DOMnodeUID uid : added)
+                tree.deleteSubtree(uid);
+            added.clear();
+            tree.invalidateLabels();
+        }
+    };
+} // namespace dom_parser
+
+#endif
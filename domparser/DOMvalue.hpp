@@ -0,0 +1,112 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_VALUE
+#define DOM_PARSER_DOM_VALUE
+
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Trims the XML white space around a value.
+     * */
+    inline std::string_view trim_value(std::string_view text)
+    {
+        constexpr std::string_view space = " \t\r\n";
+        std::size_t begin = text.find_first_not_of(space);
+        if (begin == std::string_view::npos)
+            return std::string_view();
+        return text.substr(begin, text.find_last_not_of(space) - begin + 1);
+    }
+
+    /**
+     *  @brief  Drops the leading '+' of a number, which std::from_chars
+     *          rejects. Returns false for a sign followed by another sign.
+     * */
+    inline bool strip_plus_sign(std::string_view &text)
+    {
+        if (text.empty() || text.front() != '+')
+            return true;
+        text.remove_prefix(1);
+        return text.empty() || (text.front() != '+' && text.front() != '-');
+    }
+
+    /**
+     *  @brief  Parses a whole value as a decimal integer, white space around
+     *          it allowed. Nothing is allocated.
+     *  @param  text    the value
+     *  @param  value   set to the integer, untouched on failure
+     *  @return false if the value is not an integer or is out of range
+     * */
+    inline bool parse_value(std::string_view text, long long &value)
+    {
+        text = trim_value(text);
+        if (!strip_plus_sign(text))
+            return false;
+        const char *end = text.data() + text.size();
+        long long parsed;
+        auto result = std::from_chars(text.data(), end, parsed);
+        if (result.ec != std::errc() || result.ptr != end)
+            return false;
+        value = parsed;
+        return true;
+    }
+
+    /**
+     *  @brief  Parses a whole value as a floating point number in fixed or
+     *          scientific notation, white space around it allowed.
+     *  @param  text    the value
+     *  @param  value   set to the number, untouched on failure
+     *  @return false if the value is not a number or is out of range
+     * */
+    inline bool parse_value(std::string_view text, double &value)
+    {
+        text = trim_value(text);
+        if (!strip_plus_sign(text))
+            return false;
+        const char *end = text.data() + text.size();
+        double parsed;
+        auto result = std::from_chars(text.data(), end, parsed);
+        if (result.ec != std::errc() || result.ptr != end)
+            return false;
+        value = parsed;
+        return true;
+    }
+
+    /**
+     *  @brief  Parses a whole value as an xs:boolean: true, false, 1 or 0,
+     *          white space around it allowed.
+     *  @param  text    the value
+     *  @param  value   set to the boolean, untouched on failure
+     *  @return false if the value is not a boolean
+     * */
+    inline bool parse_value(std::string_view text, bool &value)
+    {
+        text = trim_value(text);
+        if (text == "true" || text == "1")
+            value = true;
+        else if (text == "false" || text == "0")
+            value = false;
+        else
+            return false;
+        return true;
+    }
+
+} // namespace dom_parser
+
+#endif
@@ -0,0 +1,578 @@
+//    Copyright 2020 Mayank Mathur (mynk-9 at Github)
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+
+#ifndef DOM_PARSER_DOM_WRITER
+#define DOM_PARSER_DOM_WRITER
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define DOM_PARSER_HAS_WRITEV
+#endif
+
+#include "DOMentities.hpp"
+#include "DOMtree.hpp"
+
+namespace dom_parser
+{
+    /**
+     *  @brief  Serializes a DOMtree back to markup. Subtrees are written
+     *          iteratively with the indentation derived from their depth, so
+     *          any subtree can be written on its own and the pieces of a
+     *          document can be produced on several threads and joined in
+     *          document order.
+     * */
+    class tree_writer
+    {
+    private:
+        struct frame
+        {
+            DOMnodeUID node;
+            std::list<DOMnodeUID>::const_iterator next;
+        };
+
+        /**
+         *  @brief  One piece of the document in the parallel writer: either
+         *          a whole subtree written by a worker, or the open/close tag
+         *          lines of a large ancestor written by the caller.
+         * */
+        struct piece
+        {
+            DOMnodeUID node;
+            std::size_t depth;
+            bool subtree;
+            std::string text;
+        };
+
+        const DOMtree &tree;
+        std::string indent;
+        std::string indentation;
+        std::string newline;
+
+        inline void write_indentation(std::string &out, std::size_t depth) const
+        {
+            out += indentation;
+            for (std::size_t i = 0; i < depth; i++)
+                out += indent;
+        }
+
+        /**
+         *  @brief  Writes a text node or the opening tag of an element.
+         *  @return true if the element has children and must be closed.
+         * */
+        bool write_open(std::string &out, const DOMnode &node, std::size_t depth) const
+        {
+            write_indentation(out, depth);
+            if (node.isInnerDataNode())
+            {
+                append_escaped(out, node.getInnerData(), false);
+                out += newline;
+                return false;
+            }
+
+            out += '<';
+            out += node.getTagName();
+            for (const auto &i : node.getAllAttributes())
+            {
+                out += ' ';
+                out += i.first;
+                if (!i.second.empty())
+                {
+                    out += "=\"";
+                    append_escaped(out, i.second, true);
+                    out += '\"';
+                }
+            }
+            if (node.getChildrenUID().empty())
+            {
+                out += " />";
+                out += newline;
+                return false;
+            }
+            out += '>';
+            out += newline;
+            return true;
+        }
+
+        void write_close(std::string &out, const DOMnode &node, std::size_t depth) const
+        {
+            write_indentation(out, depth);
+            out += "</";
+            out += node.getTagName();
+            out += '>';
+            out += newline;
+        }
+
+        /**
+         *  @brief  Rough size in bytes of the markup of a single node, used to
+         *          balance the subtrees handed to the workers.
+         * */
+        std::size_t weight(const DOMnode &node) const
+        {
+            if (node.isInnerDataNode())
+                return node.getInnerData().size() + newline.size() + 1;
+            std::size_t w = 2 * node.getTagName().size() + 6 + 2 * newline.size();
+            for (const auto &i : node.getAllAttributes())
+                w += i.first.size() + i.second.size() + 4;
+            return w;
+        }
+
+        /**
+         *  @brief  Splits the subtree under root into pieces in document
+         *          order. Subtrees whose weight is at most target become
+         *          whole pieces, larger ones are split below their tags.
+         * */
+        std::vector<piece> partition(DOMnodeUID root, std::size_t depth, std::size_t threads) const
+        {
+            // preorder walk assigning each node the weight of its subtree
+            std::vector<DOMnodeUID> order;
+            std::vector<std::size_t> subtree_weight;
+            std::vector<std::size_t> subtree_nodes;
+            std::vector<std::pair<std::size_t, std::list<DOMnodeUID>::const_iterator>> stack;
+            order.reserve(tree.getNodeCount());
+            subtree_weight.reserve(tree.getNodeCount());
+            subtree_nodes.reserve(tree.getNodeCount());
+
+            order.push_back(root);
+            subtree_weight.push_back(weight(tree.getNode(root)));
+            subtree_nodes.push_back(1);
+            stack.emplace_back(0, tree.getNode(root).getChildrenUID().begin());
+            while (!stack.empty())
+            {
+                auto &top = stack.back();
+                const DOMnode &node = tree.getNode(order[top.first]);
+                if (top.second == node.getChildrenUID().end())
+                {
+                    std::size_t done = top.first;
+                    stack.pop_back();
+                    if (!stack.empty())
+                    {
+                        subtree_weight[stack.back().first] += subtree_weight[done];
+                        subtree_nodes[stack.back().first] += subtree_nodes[done];
+                    }
+                    continue;
+                }
+                DOMnodeUID child = *top.second++;
+                order.push_back(child);
+                subtree_weight.push_back(weight(tree.getNode(child)));
+                subtree_nodes.push_back(1);
+                stack.emplace_back(order.size() - 1, tree.getNode(child).getChildrenUID().begin());
+            }
+
+            // several pieces per thread so that uneven subtrees even out
+            std::size_t target = std::max<std::size_t>(subtree_weight[0] / (threads * 8), 1 << 12);
+
+            std::vector<piece> pieces;
+            auto text = [&]() -> std::string & {
+                if (pieces.empty() || pieces.back().subtree)
+                    pieces.push_back({-1, 0, false, std::string()});
+                return pieces.back().text;
+            };
+
+            // second walk in preorder; i is the preorder index of the next
+            // node visited, a subtree written whole is skipped over at once
+            struct split
+            {
+                DOMnodeUID node;
+                std::size_t depth;
+                std::list<DOMnodeUID>::const_iterator next;
+            };
+            std::vector<split> open;
+            std::size_t i = 0;
+            auto visit = [&](DOMnodeUID uid, std::size_t d) {
+                const DOMnode &node = tree.getNode(uid);
+                if (subtree_weight[i] <= target || node.getChildrenUID().empty())
+                {
+                    pieces.push_back({uid, d, true, std::string()});
+                    i += subtree_nodes[i];
+                    return false;
+                }
+                i++;
+                write_open(text(), node, d);
+                open.push_back({uid, d, node.getChildrenUID().begin()});
+                return true;
+            };
+
+            if (!visit(root, depth))
+                return pieces;
+            while (!open.empty())
+            {
+                split &top = open.back();
+                const DOMnode &node = tree.getNode(top.node);
+                if (top.next == node.getChildrenUID().end())
+                {
+                    write_close(text(), node, top.depth);
+                    open.pop_back();
+                    continue;
+                }
+                DOMnodeUID child = *top.next++;
+                visit(child, top.depth + 1);
+            }
+            return pieces;
+        }
+
+        /**
+         *  @brief  Fills in the subtree pieces on up to threads threads.
+         * */
+        void write_pieces(std::vector<piece> &pieces, std::size_t threads) const
+        {
+            std::vector<std::size_t> jobs;
+            for (std::size_t i = 0; i < pieces.size(); i++)
+                if (pieces[i].subtree)
+                    jobs.push_back(i);
+
+            std::atomic<std::size_t> next(0);
+            auto work = [&]() {
+                std::size_t job;
+                while ((job = next.fetch_add(1, std::memory_order_relaxed)) < jobs.size())
+                {
+                    piece &p = pieces[jobs[job]];
+                    write(p.text, p.node, p.depth);
+                }
+            };
+
+            std::vector<std::thread> workers;
+            threads = std::min(threads, jobs.size());
+            for (std::size_t t = 1; t < threads; t++)
+                workers.emplace_back(work);
+            work();
+            for (auto &w : workers)
+                w.join();
+        }
+
+        static std::size_t resolve_threads(unsigned threads)
+        {
+            if (threads == 0)
+                threads = std::thread::hardware_concurrency();
+            return threads == 0 ? 1 : threads;
+        }
+
+    public:
+        /**
+         *  @brief  Creates a writer for the given tree.
+         *  @param  tree        Tree to serialize.
+         *  @param  minified    If output is required to be in minified form.
+         *  @param  indent      String which denotes one level of indentation.
+         *  @param  indentation Indentation applied on the top node written.
+         * */
+        tree_writer(const DOMtree &tree, bool minified = false, std::string indent = "    ",
+                    std::string indentation = "")
+            : tree(tree),
+              indent(minified ? "" : std::move(indent)),
+              indentation(minified ? "" : std::move(indentation)),
+              newline(minified ? "" : "\n")
+        {
+        }
+
+        /**
+         *  @brief  Appends the markup of the subtree under node to out.
+         *  @param  out     Buffer to append to.
+         *  @param  node    Root of the subtree.
+         *  @param  depth   Indentation level of node.
+         * */
+        void write(std::string &out, DOMnodeUID node, std::size_t depth = 0) const
+        {
+            std::vector<frame> stack;
+            const DOMnode &root = tree.getNode(node);
+            if (write_open(out, root, depth))
+                stack.push_back({node, root.getChildrenUID().begin()});
+            while (!stack.empty())
+            {
+                frame &top = stack.back();
+                const DOMnode &current = tree.getNode(top.node);
+                std::size_t level = depth + stack.size() - 1;
+                if (top.next == current.getChildrenUID().end())
+                {
+                    write_close(out, current, level);
+                    stack.pop_back();
+                    continue;
+                }
+                DOMnodeUID child = *top.next++;
+                const DOMnode &child_node = tree.getNode(child);
+                if (write_open(out, child_node, level + 1))
+                    stack.push_back({child, child_node.getChildrenUID().begin()});
+            }
+        }
+
+        /**
+         *  @brief  Returns the markup of the subtree under node.
+         * */
+        std::string write(DOMnodeUID node = 0) const
+        {
+            std::string out;
+            if (tree.checkNodeExistance(node))
+                write(out, node);
+            return out;
+        }
+
+        /**
+         *  @brief  Returns the markup of the subtrees under the given nodes,
+         *          one after another, each at the top level of indentation.
+         *          Nodes which do not exist are skipped.
+         * */
+        std::string write_nodes(const std::vector<DOMnodeUID> &nodes) const
+        {
+            std::string out;
+            for (DOMnodeUID node : nodes)
+                if (tree.checkNodeExistance(node))
+                    write(out, node);
+            return out;
+        }
+
+        class cursor;
+
+        /**
+         *  @brief  Returns a cursor over the markup of the subtree under node.
+         * */
+        cursor make_cursor(DOMnodeUID node = 0) const;
+
+        /**
+         *  @brief  Returns a cursor over the markup of the subtrees under the
+         *          given nodes, as write_nodes() would write them.
+         * */
+        cursor make_cursor(std::vector<DOMnodeUID> nodes) const;
+
+        /**
+         *  @brief  Returns the markup of the subtree under node, written
+         *          by several threads.
+         *  @param  node    Root of the subtree.
+         *  @param  threads Number of threads, 0 for the hardware concurrency.
+         * */
+        std::string write_parallel(DOMnodeUID node = 0, unsigned threads = 0) const
+        {
+            std::string out;
+            if (!tree.checkNodeExistance(node))
+                return out;
+            std::size_t n = resolve_threads(threads);
+            if (n == 1)
+            {
+                write(out, node);
+                return out;
+            }
+
+            std::vector<piece> pieces = partition(node, 0, n);
+            write_pieces(pieces, n);
+            std::size_t total = 0;
+            for (const piece &p : pieces)
+                total += p.text.size();
+            out.reserve(total);
+            for (const piece &p : pieces)
+                out += p.text;
+            return out;
+        }
+
+        /**
+         *  @brief  Writes the markup of the subtree under node to a file,
+         *          produced by several threads. The pieces are written in
+         *          document order straight from the per-thread buffers,
+         *          with writev() where it is available.
+         *  @param  path    Output file path, truncated if it exists.
+         *  @param  node    Root of the subtree.
+         *  @param  threads Number of threads, 0 for the hardware concurrency.
+         *  @return 0 on success, -2 if the file could not be written.
+         * */
+        int write_parallel(const std::filesystem::path &path, DOMnodeUID node = 0,
+                           unsigned threads = 0) const
+        {
+            std::vector<piece> pieces;
+            if (tree.checkNodeExistance(node))
+            {
+                std::size_t n = resolve_threads(threads);
+                if (n == 1)
+                {
+                    pieces.push_back({node, 0, true, std::string()});
+                    write(pieces.back().text, node);
+                }
+                else
+                {
+                    pieces = partition(node, 0, n);
+                    write_pieces(pieces, n);
+                }
+            }
+
+#ifdef DOM_PARSER_HAS_WRITEV
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+                return -2;
+
+            std::vector<iovec> iov;
+            for (piece &p : pieces)
+                if (!p.text.empty())
+                    iov.push_back({&p.text[0], p.text.size()});
+
+            std::size_t first = 0;
+            while (first < iov.size())
+            {
+                int count = int(std::min<std::size_t>(iov.size() - first, IOV_MAX));
+                ssize_t written = ::writev(fd, &iov[first], count);
+                if (written < 0)
+                {
+                    ::close(fd);
+                    return -2;
+                }
+                // drop the buffers written completely, trim a partial one
+                std::size_t left = std::size_t(written);
+                while (first < iov.size() && left >= iov[first].iov_len)
+                    left -= iov[first++].iov_len;
+                if (left > 0)
+                {
+                    iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + left;
+                    iov[first].iov_len -= left;
+                }
+            }
+            return ::close(fd) == 0 ? 0 : -2;
+#else
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            for (const piece &p : pieces)
+                file.write(p.text.data(), std::streamsize(p.text.size()));
+            return file ? 0 : -2;
+#endif
+        }
+    };
+
+    /**
+     *  @brief  Resumable writer which hands out the markup of a list of
+     *          subtrees in chunks of bounded size. The tree must not be
+     *          modified while a cursor over it is in use.
+     * */
+    class tree_writer::cursor
+    {
+    private:
+        tree_writer writer;
+        std::vector<DOMnodeUID> roots;
+        std::size_t next_root = 0;
+        std::vector<frame> stack;
+        std::string pending; // written but not yet handed out
+        std::size_t pending_offset = 0;
+
+        /**
+         *  @brief  Writes the next line of markup into pending.
+         *  @return false once everything has been written.
+         * */
+        bool step()
+        {
+            if (stack.empty())
+            {
+                while (next_root < roots.size() && !writer.tree.checkNodeExistance(roots[next_root]))
+                    next_root++;
+                if (next_root == roots.size())
+                    return false;
+                DOMnodeUID root = roots[next_root++];
+                const DOMnode &node = writer.tree.getNode(root);
+                if (writer.write_open(pending, node, 0))
+                    stack.push_back({root, node.getChildrenUID().begin()});
+                return true;
+            }
+
+            frame &top = stack.back();
+            const DOMnode &current = writer.tree.getNode(top.node);
+            std::size_t level = stack.size() - 1;
+            if (top.next == current.getChildrenUID().end())
+            {
+                writer.write_close(pending, current, level);
+                stack.pop_back();
+                return true;
+            }
+            DOMnodeUID child = *top.next++;
+            const DOMnode &child_node = writer.tree.getNode(child);
+            if (writer.write_open(pending, child_node, level + 1))
+                stack.push_back({child, child_node.getChildrenUID().begin()});
+            return true;
+        }
+
+        /**
+         *  @brief  Makes at least max_bytes available in pending, unless
+         *          the output ends first, and returns how many are.
+         * */
+        std::size_t fill(std::size_t max_bytes)
+        {
+            if (pending_offset > 0 && pending_offset >= pending.size() / 2)
+            {
+                pending.erase(0, pending_offset);
+                pending_offset = 0;
+            }
+            while (pending.size() - pending_offset < max_bytes && step())
+                ;
+            return std::min(max_bytes, pending.size() - pending_offset);
+        }
+
+    public:
+        cursor(const tree_writer &writer, std::vector<DOMnodeUID> roots)
+            : writer(writer), roots(std::move(roots))
+        {
+        }
+
+        /**
+         *  @brief  Appends up to max_bytes of the output to out,
+         *          continuing where the previous call stopped.
+         *  @return Number of bytes appended, 0 once the output is done.
+         * */
+        std::size_t next(std::string &out, std::size_t max_bytes)
+        {
+            std::size_t n = fill(max_bytes);
+            out.append(pending, pending_offset, n);
+            pending_offset += n;
+            return n;
+        }
+
+        /**
+         *  @brief  Copies up to max_bytes of the output into buffer,
+         *          continuing where the previous call stopped.
+         *  @return Number of bytes copied, 0 once the output is done.
+         * */
+        std::size_t next(char *buffer, std::size_t max_bytes)
+        {
+            std::size_t n = fill(max_bytes);
+            pending.copy(buffer, n, pending_offset);
+            pending_offset += n;
+            return n;
+        }
+
+        /**
+         *  @brief  Returns true once all of the output has been handed out.
+         * */
+        bool done() const
+        {
+            return pending_offset == pending.size() && stack.empty() &&
+                   (next_root == roots.size() ||
+                    std::none_of(roots.begin() + next_root, roots.end(), [this](DOMnodeUID node) {
+                        return writer.tree.checkNodeExistance(node);
+                    }));
+        }
+    };
+
+    inline tree_writer::cursor tree_writer::make_cursor(DOMnodeUID node) const
+    {
+        return cursor(*this, {node});
+    }
+
+    inline tree_writer::cursor tree_writer::make_cursor(std::vector<DOMnodeUID> nodes) const
+    {
+        return cursor(*this, std::move(nodes));
+    }
+} // namespace dom_parser
+
+#endif
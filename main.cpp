@@ -42,7 +42,15 @@ int main()
     long long ms = loadTest.run(output_file);
     cout << "Completed Load Test on " << files[select_file] << " in " << ms << " milliseconds.\n";
 
-    return 0;
+    bool passed = true;
+    passed &= compactTest.run("./test/part.xml");
+    passed &= entityTest.run();
+    passed &= markupTextTest.run();
+    passed &= recoverTest.run();
+    passed &= incrementalUpdateTest.run();
+    cout << (passed ? "All checks passed.\n" : "Some checks failed.\n");
+
+    return passed ? 0 : 1;
 }
 
 // this file is for testing purposes
\ No newline at end of file
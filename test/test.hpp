@@ -20,14 +20,38 @@ THE CODE HERE IS NOT DOCUMENTED.
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <chrono>
+#include <tuple>
+#include <vector>
 
 #include <filesystem>
 
 #include "./../domparser/DOMparser.hpp"
+#include "./../domparser/DOMbatch.hpp"
+#include "./../domparser/DOMdiff.hpp"
+#include "./../domparser/DOMparserPool.hpp"
 
 using namespace std;
 
+// Xorshift generator of the randomized tests, with a fixed seed so that
+// runs can be compared.
+struct testRandom
+{
+    unsigned long long state = 88172645463325252ULL;
+
+    unsigned long long next()
+    {
+        state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+        return state;
+    }
+
+    dom_parser::DOMnodeUID below(long long bound)
+    {
+        return dom_parser::DOMnodeUID(next() % bound);
+    }
+};
+
 struct loadTest
 {
 private:
@@ -36,6 +60,7 @@ private:
     dom_parser::DOMparser parser;
     bool verbose = true;
     bool use_primitive = false;
+    bool use_fast = false;
 
     inline void debug_print(string s)
     {
@@ -63,6 +88,10 @@ public:
     {
         use_primitive = _primitive;
     }
+    inline void set_fast(bool _fast)
+    {
+        use_fast = _fast;
+    }
     long long run(const string output_file)
     {
         // run test
@@ -70,7 +99,9 @@ public:
 
         auto timer_start = chrono::steady_clock::now();
         int e;
-        if (!use_primitive)
+        if (use_fast)
+            e = parser.loadTree_fast(file);
+        else if (!use_primitive)
             e = parser.loadTree(file);
         else
             e = parser.loadTree_primitive(file);
@@ -131,4 +162,635 @@ struct oldTests
         fin.close();
         fout.close();
     }
-} oldTests;
\ No newline at end of file
+} oldTests;
+struct lexerTest
+{
+    long long time_lexing(const filesystem::path &file, bool validate_utf8, int rounds)
+    {
+        auto timer_start = chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i)
+        {
+            dom_parser::lexer _lexer(file, validate_utf8);
+            while (_lexer.next()->token != dom_parser::lexer_token_values::T_FILEEND)
+                ;
+        }
+        auto timer_stop = chrono::steady_clock::now();
+        return chrono::duration_cast<chrono::microseconds>(timer_stop - timer_start).count() / rounds;
+    }
+    void run(string path, int rounds = 10)
+    {
+        long long raw = time_lexing(path, false, rounds);
+        long long validated = time_lexing(path, true, rounds);
+        cout << "Lexing " << path << ": " << raw << " us raw, " << validated
+             << " us with UTF-8 validation (" << (raw ? (validated - raw) * 100 / raw : 0) << "% overhead).\n";
+    }
+} lexerTest;
+
+struct entityTest
+{
+    // Loads entity and character references with the lexer and with
+    // fast_parser, checks the decoded values, then loads the escaped output
+    // again and checks that nothing changed.
+    bool run()
+    {
+        const string doc = "<r a=\"&lt;&amp;&quot;&#65;=1\"><t>&lt;x&gt; &amp; &apos;&#x42;&#67; a/b=\"c\"</t></r>";
+        const string attribute = "<&\"A=1", text = "<x> & 'BC a/b=\"c\"";
+
+        bool ok = true;
+        for (bool fast : {false, true})
+        {
+            auto load = [fast](dom_parser::DOMparser &parser, const string &data) {
+                unique_ptr<dom_parser::input_source> source(new dom_parser::memory_source(string(data)));
+                return fast ? parser.loadTree_fast(std::move(source)) : parser.loadTree(std::move(source));
+            };
+            auto decoded = [&](dom_parser::DOMparser &parser) {
+                dom_parser::DOMtree &tree = parser.borrowTree();
+                const auto &children = tree.getNode(0).getChildrenUID();
+                if (children.size() != 1 || tree.getNode(children.front()).getChildrenUID().size() != 1)
+                    return false;
+                dom_parser::DOMnodeUID inner = tree.getNode(children.front()).getChildrenUID().front();
+                return tree.getNode(0).getAttribute("a") == attribute && tree.getNode(inner).getInnerData() == text;
+            };
+
+            dom_parser::DOMparser parser, reparser;
+            ok = ok && load(parser, doc) == 0 && decoded(parser);
+            string output = parser.getOutput(true);
+            ok = ok && load(reparser, output) == 0 && decoded(reparser) && reparser.getOutput(true) == output;
+        }
+
+        cout << "Entity decoding and escaping test with the lexer and fast_parser: "
+             << (ok ? "passed" : "failed") << ".\n";
+        return ok;
+    }
+} entityTest;
+
+struct markupTextTest
+{
+    // Loads text around CDATA sections, comments and processing instructions
+    // with the lexer and with fast_parser, checks that each run is one node
+    // with the white space of the input, then loads the output again.
+    bool run()
+    {
+        const vector<pair<string, string>> cases = {
+            {"<r>a <![CDATA[b]]> c</r>", "a b c"},
+            {"<r>word<!-- c -->word</r>", "wordword"},
+            {"<r>word <?pi x?>word</r>", "word word"},
+            {"<r>x<![CDATA[<b>&amp;]]>y &amp;<!---->z</r>", "x<b>&amp;y &z"},
+            {"<r><e/> <!-- c --> <e/></r>", ""},
+        };
+
+        bool ok = true;
+        for (bool fast : {false, true})
+            for (auto const &test : cases)
+            {
+                auto load = [fast](dom_parser::DOMparser &parser, const string &data) {
+                    unique_ptr<dom_parser::input_source> source(new dom_parser::memory_source(string(data)));
+                    return fast ? parser.loadTree_fast(std::move(source)) : parser.loadTree(std::move(source));
+                };
+                auto text = [&](dom_parser::DOMparser &parser) {
+                    dom_parser::DOMtree &tree = parser.borrowTree();
+                    const auto &children = tree.getNode(0).getChildrenUID();
+                    if (test.second.empty()) // no text nodes
+                        return std::none_of(children.begin(), children.end(), [&](dom_parser::DOMnodeUID uid) {
+                            return tree.getNode(uid).isInnerDataNode();
+                        });
+                    return children.size() == 1 && tree.getNode(children.front()).getInnerData() == test.second;
+                };
+
+                dom_parser::DOMparser parser, reparser;
+                ok = ok && load(parser, test.first) == 0 && text(parser);
+                ok = ok && load(reparser, parser.getOutput(true)) == 0 && text(reparser);
+            }
+
+        cout << "CDATA, comment and processing instruction text test with the lexer and fast_parser: "
+             << (ok ? "passed" : "failed") << ".\n";
+        return ok;
+    }
+} markupTextTest;
+
+struct recoverTest
+{
+    struct expected_diagnostic
+    {
+        size_t offset, line;
+        string message;
+    };
+
+    // Loads broken documents with loadTree_recover and checks the recovered
+    // tree and the diagnostics for mismatched, stray and malformed tags.
+    bool run()
+    {
+        const vector<tuple<string, string, vector<expected_diagnostic>>> cases = {
+            {"<r><a><b>x</a>\n<c>y</c></z></r>", "<r><a><b>x</b></a><c>y</c></r>",
+             {{10, 1, "element <b> closed by </a>"}, {23, 2, "stray closing tag </z>, ignored"}}},
+            {"<r><a x=>t</a><b/>", "<r><b /></r>",
+             {{3, 1, "malformed tag"}, {10, 1, "stray closing tag </a>, ignored"}, {18, 1, "element <r> not closed"}}},
+            {"<r>a</r><e/>", "<r>a<e /></r>",
+             {{8, 1, "element <e> after the root, added to the root"}}},
+        };
+
+        bool ok = true;
+        for (auto const &test : cases)
+        {
+            dom_parser::DOMparser parser;
+            unique_ptr<dom_parser::input_source> source(new dom_parser::memory_source(string(get<0>(test))));
+            ok = ok && parser.loadTree_recover(std::move(source)) == 0 && parser.getOutput(true) == get<1>(test);
+
+            const auto &found = parser.getDiagnostics();
+            const auto &wanted = get<2>(test);
+            ok = ok && found.size() == wanted.size();
+            for (size_t i = 0; ok && i < found.size(); ++i)
+                ok = found[i].offset == wanted[i].offset && found[i].line == wanted[i].line &&
+                     found[i].message == wanted[i].message;
+        }
+
+        cout << "Recovering load test with mismatched and stray tags: " << (ok ? "passed" : "failed") << ".\n";
+        return ok;
+    }
+} recoverTest;
+
+struct fastParserTest
+{
+    void run(string path, int rounds = 10)
+    {
+        dom_parser::DOMparser lexer_parser, fast_parser;
+        long long lexer_time = 0, fast_time = 0;
+        for (int i = 0; i < rounds; ++i)
+        {
+            auto timer_start = chrono::steady_clock::now();
+            lexer_parser.loadTree(filesystem::path(path));
+            auto timer_mid = chrono::steady_clock::now();
+            fast_parser.loadTree_fast(path);
+            auto timer_stop = chrono::steady_clock::now();
+            lexer_time += chrono::duration_cast<chrono::microseconds>(timer_mid - timer_start).count();
+            fast_time += chrono::duration_cast<chrono::microseconds>(timer_stop - timer_mid).count();
+        }
+        cout << "Parsing " << path << ": " << lexer_time / rounds << " us with lexer, "
+             << fast_time / rounds << " us with fast_parser, outputs "
+             << (lexer_parser.getOutput() == fast_parser.getOutput() ? "match" : "differ") << ".\n";
+    }
+} fastParserTest;
+
+struct poolThroughputTest
+{
+    // Parses many small documents with a new parser each, then with parsers
+    // from DOMparserPool, which keep their storage between documents. Trees
+    // copied out of pooled parsers are checked to outlive the recycling.
+    void run(int documents = 100000, int items = 10)
+    {
+        auto make_document = [](int items) {
+            string doc = "<order id=\"1\">";
+            for (int i = 0; i < items; ++i)
+                doc += "<item sku=\"" + to_string(i) + "\"><name>part " + to_string(i) + "</name><qty>2</qty></item>";
+            return doc + "</order>";
+        };
+        string doc = make_document(items);
+
+        long long nodes = 0;
+        auto timer_start = chrono::steady_clock::now();
+        for (int i = 0; i < documents; ++i)
+        {
+            dom_parser::DOMparser parser;
+            parser.loadTree_fast(unique_ptr<dom_parser::input_source>(new dom_parser::memory_source(string(doc))));
+            nodes += parser.borrowTree().getNodeCount();
+        }
+        auto timer_mid = chrono::steady_clock::now();
+        for (int i = 0; i < documents; ++i)
+        {
+            auto parser = dom_parser::DOMparserPool::acquire();
+            parser->loadTree_fast(unique_ptr<dom_parser::input_source>(new dom_parser::memory_source(string(doc))));
+            nodes -= parser->borrowTree().getNodeCount();
+        }
+        auto timer_stop = chrono::steady_clock::now();
+
+        dom_parser::DOMtree kept;
+        {
+            auto parser = dom_parser::DOMparserPool::acquire();
+            parser->loadTree_fast(unique_ptr<dom_parser::input_source>(new dom_parser::memory_source(string(doc))));
+            kept = parser->getTree();
+        }
+        {
+            auto parser = dom_parser::DOMparserPool::acquire();
+            parser->loadTree_fast(unique_ptr<dom_parser::input_source>(new dom_parser::memory_source(make_document(items * 4))));
+        }
+        bool kept_ok = kept.getNodeCount() == 1 + items * 5 && !kept.getNode(0).isDeleted();
+
+        auto fresh = chrono::duration_cast<chrono::microseconds>(timer_mid - timer_start).count();
+        auto pooled = chrono::duration_cast<chrono::microseconds>(timer_stop - timer_mid).count();
+        cout << "Parsing " << documents << " small documents: " << (fresh ? documents * 1000000LL / fresh : 0)
+             << " docs/s with new parsers, " << (pooled ? documents * 1000000LL / pooled : 0)
+             << " docs/s with pooled parsers, " << (nodes == 0 ? "same trees" : "trees differ")
+             << ", copies " << (kept_ok ? "intact" : "broken") << ".\n";
+    }
+} poolThroughputTest;
+
+// Names of test/part.xml, the part table of TPC-H.
+struct partSchema
+{
+    static constexpr string_view tags[] = {"table", "T", "P_PARTKEY", "P_NAME", "P_MFGR", "P_BRAND", "P_TYPE",
+                                           "P_SIZE", "P_CONTAINER", "P_RETAILPRICE", "P_COMMENT"};
+    static constexpr string_view attributes[] = {"ID"};
+};
+
+struct schemaParserTest
+{
+    // Loads a document conforming to partSchema into a DOMtree with
+    // fast_parser and into a DOMschemaTree, then sums the retail prices of
+    // both trees to check they hold the same values.
+    void run(string path = "./test/part.xml", int rounds = 10)
+    {
+        using part_tree = dom_parser::DOMschemaTree<partSchema>;
+        dom_parser::DOMparser generic_parser, schema_parser;
+        part_tree tree;
+        long long generic_time = 0, schema_time = 0;
+        for (int i = 0; i < rounds; ++i)
+        {
+            generic_parser.reset();
+            auto timer_start = chrono::steady_clock::now();
+            generic_parser.loadTree_fast(path);
+            auto timer_mid = chrono::steady_clock::now();
+            schema_parser.loadTree_fast(filesystem::path(path), tree);
+            auto timer_stop = chrono::steady_clock::now();
+            generic_time += chrono::duration_cast<chrono::microseconds>(timer_mid - timer_start).count();
+            schema_time += chrono::duration_cast<chrono::microseconds>(timer_stop - timer_mid).count();
+        }
+
+        double generic_sum = 0, schema_sum = 0, price;
+        dom_parser::DOMtree &generic_tree = generic_parser.borrowTree();
+        for (dom_parser::DOMnodeUID uid = 0; uid < generic_tree.getNodeCount(); ++uid)
+            if (generic_tree.getNode(uid).getTagName() == "P_RETAILPRICE" && generic_tree.getDouble(uid, price) == 0)
+                generic_sum += price;
+        for (dom_parser::DOMnodeUID uid = 0; uid < tree.getNodeCount(); ++uid)
+        {
+            auto node = tree.getNode(uid);
+            if (node.getKind() == part_tree::kind("P_RETAILPRICE") && !node.getChildrenUID().empty() &&
+                dom_parser::parse_value(tree.getNode(*node.getChildrenUID().begin()).getInnerData(), price))
+                schema_sum += price;
+        }
+
+        cout << "Parsing " << path << ": " << generic_time / rounds << " us into DOMtree, "
+             << schema_time / rounds << " us into DOMschemaTree, node counts "
+             << (generic_tree.getNodeCount() == tree.getNodeCount() ? "match" : "differ") << ", sums "
+             << (generic_sum == schema_sum ? "match" : "differ") << ".\n";
+    }
+} schemaParserTest;
+
+struct uidScaleTest
+{
+    // Multi-billion node runs need DOM_PARSER_64BIT_UID and a machine with
+    // a few hundred bytes of memory per node.
+    bool run(long long node_count, long long records_per_group = 1000)
+    {
+        dom_parser::DOMtreeBuilder builder(node_count);
+        long long added = 1;
+        builder.open("root");
+        while (added < node_count)
+        {
+            builder.open("group");
+            ++added;
+            for (long long i = 0; i < records_per_group && added < node_count; ++i, ++added)
+                builder.open("record").close();
+            builder.close();
+        }
+        builder.close();
+        dom_parser::DOMtree tree = builder.release();
+
+        dom_parser::DOMnodeUID last = node_count - 1;
+        bool ok = (tree.getNodeCount() == node_count) &&
+                  (last < 1 || tree.isAncestor(0, last)) &&
+                  (tree.getDepth(last) <= 2);
+        cout << "UID scale test with " << node_count << " nodes and " << sizeof(dom_parser::DOMnodeUID) * 8
+             << "-bit UIDs: " << (ok ? "passed" : "failed") << ".\n";
+        return ok;
+    }
+} uidScaleTest;
+
+struct ancestryTest
+{
+    // Moves records between the sections of a deep hierarchy, each move
+    // checking for cycles, interleaved with isAncestor queries. Moves label
+    // the moved nodes in place, so checks keep answering from the labels;
+    // the same checks through the parent walk of getAncestorList are timed
+    // for comparison.
+    void run(int node_count = 1000000, int operations = 100000)
+    {
+        testRandom random;
+
+        // sections hang below one of the 1000 sections before them, records
+        // below any section
+        int sections = node_count / 2;
+        dom_parser::DOMtree tree("root");
+        for (int i = 1; i < sections; ++i)
+            tree.addNode(i - 1 - random.below(std::min(i, 1000)), "section");
+        for (int i = sections; i < node_count; ++i)
+            tree.addNode(random.below(sections), "record");
+
+        long long moved = 0, found = 0;
+        auto timer_start = chrono::steady_clock::now();
+        for (int i = 0; i < operations; ++i)
+        {
+            dom_parser::DOMnodeUID record = sections + random.below(node_count - sections);
+            moved += tree.moveSubtree(record, random.below(sections));
+            found += tree.isAncestor(random.below(sections), random.below(node_count));
+        }
+        auto timer_mid = chrono::steady_clock::now();
+        for (int i = 0; i < operations; ++i)
+        {
+            dom_parser::DOMnodeUID section = random.below(sections);
+            vector<dom_parser::DOMnodeUID> ancestors = tree.getAncestorList(random.below(node_count));
+            found += std::find(ancestors.begin(), ancestors.end(), section) != ancestors.end();
+        }
+        auto timer_stop = chrono::steady_clock::now();
+
+        cout << "Ancestry test on " << node_count << " nodes, depth " << tree.getDepth(sections - 1) << ": "
+             << operations << " moves and isAncestor checks in "
+             << chrono::duration_cast<chrono::microseconds>(timer_mid - timer_start).count() << " us, "
+             << operations << " getAncestorList checks in "
+             << chrono::duration_cast<chrono::microseconds>(timer_stop - timer_mid).count() << " us ("
+             << moved << " moved, " << found << " found).\n";
+    }
+} ancestryTest;
+
+struct compactTest
+{
+    // Deletes subtrees at random, compacts, then checks that the output is
+    // unchanged, that UIDs follow document order and that the nodes lie
+    // next to each other in memory in that order.
+    bool run(string path, int deletions = 200)
+    {
+        dom_parser::DOMparser parser;
+        if (parser.loadTree_fast(path) != 0)
+        {
+            cout << "Compact test: loading " << path << " failed.\n";
+            return false;
+        }
+        dom_parser::DOMtree &tree = parser.borrowTree();
+
+        testRandom random;
+        for (int i = 0; i < deletions; ++i)
+        {
+            dom_parser::DOMnodeUID node = 1 + random.below(tree.getNodeCount() - 1);
+            if (!tree.getNode(node).isDeleted())
+                tree.deleteSubtree(node);
+        }
+        dom_parser::DOMnodeUID live = tree.getNodeCount();
+        string before = dom_parser::tree_writer(tree, true).write();
+        tree.compact();
+        string after = dom_parser::tree_writer(tree, true).write();
+
+        bool ok = before == after && tree.getNodeCount() == live;
+        dom_parser::DOMnodeUID expected = 0;
+        vector<dom_parser::DOMnodeUID> pending = {0};
+        while (ok && !pending.empty())
+        {
+            dom_parser::DOMnodeUID node = pending.back();
+            pending.pop_back();
+            ok = node == expected && (node == 0 || &tree.getNode(node) == &tree.getNode(node - 1) + 1);
+            ++expected;
+            const auto &children = tree.getNode(node).getChildrenUID();
+            pending.insert(pending.end(), children.rbegin(), children.rend());
+        }
+        ok = ok && expected == live;
+
+        cout << "Compact test on " << path << " with " << live << " nodes left: "
+             << (ok ? "passed" : "failed") << ".\n";
+        return ok;
+    }
+} compactTest;
+
+struct diffPatchTest
+{
+    // Edits a copy of the document at random, then checks that patching the
+    // original with the diff of the two gives the edited tree back.
+    bool run(string path, int edits = 1000)
+    {
+        dom_parser::DOMparser parser;
+        if (parser.loadTree_fast(path) != 0)
+        {
+            cout << "Diff and patch test: loading " << path << " failed.\n";
+            return false;
+        }
+        dom_parser::DOMtree original = parser.getTree(), edited = original;
+
+        testRandom random;
+        for (int i = 0; i < edits; ++i)
+        {
+            dom_parser::DOMnodeUID node = random.below(edited.getNodeCount());
+            dom_parser::DOMnodeUID other = random.below(edited.getNodeCount());
+            if (edited.getNode(node).isDeleted() || edited.getNode(other).isDeleted())
+                continue;
+            bool text = edited.getNode(node).isInnerDataNode();
+            switch (i % 5)
+            {
+            case 0:
+                if (text)
+                    edited.setInnerData(node, "edit " + to_string(i));
+                else
+                    edited.setAttribute(node, "edit", to_string(i));
+                break;
+            case 1:
+                if (!text)
+                    edited.addNode(node, "added");
+                break;
+            case 2:
+                if (node != 0)
+                    edited.deleteSubtree(node);
+                break;
+            case 3:
+                if (!edited.getNode(other).isInnerDataNode())
+                    edited.moveSubtree(node, other);
+                break;
+            case 4:
+                if (!text)
+                    edited.setTagName(node, "renamed");
+                break;
+            }
+        }
+
+        auto timer_start = chrono::steady_clock::now();
+        dom_parser::DOMeditScript script = dom_parser::diff(original, edited);
+        auto timer_mid = chrono::steady_clock::now();
+        int result = dom_parser::patch(original, script);
+        auto timer_stop = chrono::steady_clock::now();
+
+        bool ok = result == 0 && original.getSubtreeHash(0) == edited.getSubtreeHash(0);
+        cout << "Diff and patch of " << path << " after " << edits << " edits: " << script.size()
+             << " edit script entries, diff "
+             << chrono::duration_cast<chrono::microseconds>(timer_mid - timer_start).count() << " us, patch "
+             << chrono::duration_cast<chrono::microseconds>(timer_stop - timer_mid).count() << " us, "
+             << (ok ? "round trip passed" : "round trip failed") << ".\n";
+        return ok;
+    }
+} diffPatchTest;
+
+struct incrementalUpdateTest
+{
+    // Edits a small document with mixed content at random, in places which
+    // keep it well formed, so that edits often meet and text nodes merge.
+    // After each edit the updated tree must match a full reparse.
+    bool run(int edits = 500)
+    {
+        string doc = "<r>";
+        for (int i = 0; i < 40; ++i)
+            doc += "t" + to_string(i) + " <e a=\"" + to_string(i) + "\">x<f/>y</e> ";
+        doc += "</r>";
+
+        dom_parser::DOMparser parser;
+        unique_ptr<dom_parser::input_source> initial(new dom_parser::memory_source(std::move(doc)));
+        if (parser.loadTree_incremental(std::move(initial)) != 0)
+        {
+            cout << "Incremental update test: loading failed.\n";
+            return false;
+        }
+
+        testRandom random;
+        bool ok = true;
+        int applied = 0;
+        long long update_time = 0;
+        for (int i = 0; i < edits && ok; ++i)
+        {
+            dom_parser::DOMtree &tree = parser.borrowTree();
+            dom_parser::DOMnodeUID node = random.below(tree.getNodeCount());
+            if (node == 0 || tree.getNode(node).isDeleted())
+                continue;
+            auto range = parser.getSourceRange(node);
+            size_t offset = range.first, removed = 0;
+            string inserted;
+            switch (i % 4)
+            {
+            case 0: // element before the node
+                inserted = "<added n=\"" + to_string(i) + "\"/>";
+                break;
+            case 1: // node replaced by an element with text
+                removed = range.second - range.first;
+                inserted = "<replaced>text " + to_string(i) + "</replaced>";
+                break;
+            case 2: // node removed, text around it may merge
+                removed = range.second - range.first;
+                break;
+            case 3: // text before the node, or inside it if it is text
+                if (tree.getNode(node).isInnerDataNode())
+                    offset += random.below(range.second - range.first);
+                inserted = " word" + to_string(i) + " ";
+                break;
+            }
+
+            auto timer_start = chrono::steady_clock::now();
+            int result = parser.updateTree(offset, removed, inserted);
+            update_time += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - timer_start).count();
+            ++applied;
+
+            dom_parser::DOMparser reparser;
+            unique_ptr<dom_parser::input_source> source(new dom_parser::memory_source(string(parser.getSource())));
+            ok = result == 0 && reparser.loadTree_fast(std::move(source)) == 0 &&
+                 reparser.borrowTree().getSubtreeHash(0) == parser.borrowTree().getSubtreeHash(0) &&
+                 reparser.getOutput() == parser.getOutput();
+        }
+
+        cout << "Incremental update with " << applied << " edits in " << update_time
+             << " us: " << (ok ? "matches full reparse" : "differs from full reparse") << ".\n";
+        return ok;
+    }
+} incrementalUpdateTest;
+
+struct parallelOutputTest
+{
+    // Compares the parallel writer against getOutput() and times both.
+    bool run(string path, unsigned threads = 0)
+    {
+        dom_parser::DOMparser parser;
+        if (parser.loadTree(std::filesystem::path(path)) != 0)
+        {
+            cout << "Parallel output test: loading " << path << " failed.\n";
+            return false;
+        }
+
+        auto timer_start = chrono::steady_clock::now();
+        string serial = parser.getOutput();
+        auto timer_serial = chrono::steady_clock::now();
+        string parallel = parser.getOutput_parallel(threads);
+        auto timer_stop = chrono::steady_clock::now();
+
+        bool ok = (serial == parallel);
+        cout << "Parallel output of " << path << " (" << serial.size() << " bytes): serial "
+             << chrono::duration_cast<chrono::microseconds>(timer_serial - timer_start).count() << " us, parallel "
+             << chrono::duration_cast<chrono::microseconds>(timer_stop - timer_serial).count() << " us, "
+             << (ok ? "identical" : "different") << ".\n";
+        return ok;
+    }
+} parallelOutputTest;
+
+struct batchLoadTest
+{
+    // Loads the files repeat times over with 1, 2, 4, ... threads up to the
+    // hardware concurrency. Mixing small and large files shows the balancing.
+    void run(vector<string> files, int repeat = 100)
+    {
+        vector<std::filesystem::path> paths;
+        for (int i = 0; i < repeat; ++i)
+            for (const auto &file : files)
+                paths.push_back(file);
+
+        unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads))
+        {
+            std::atomic<long long> nodes(0);
+            std::atomic<int> failed(0);
+            dom_parser::batch_loader loader(threads);
+            auto timer_start = chrono::steady_clock::now();
+            loader.load(paths, [&](size_t, int result, dom_parser::DOMtree &tree) {
+                if (result != 0)
+                    ++failed;
+                nodes += tree.getNodeCount();
+            });
+            auto timer_stop = chrono::steady_clock::now();
+
+            auto us = chrono::duration_cast<chrono::microseconds>(timer_stop - timer_start).count();
+            cout << "Batch load of " << paths.size() << " files on " << threads << " threads: " << us << " us, "
+                 << (us > 0 ? nodes * 1000000 / us : 0) << " nodes/s, " << failed << " failed.\n";
+            if (threads == max_threads)
+                break;
+        }
+    }
+} batchLoadTest;
+
+#ifdef DOM_PARSER_HAS_MMAP
+struct mappedTreeTest
+{
+    // Walks the mapped tree in UID order and then in random order, the gap
+    // shows the cost of page faults once the files no longer fit in memory.
+    void run(string path, string storage = "mapped_tree")
+    {
+        dom_parser::DOMparser parser;
+        dom_parser::DOMmappedTree tree;
+        auto timer_start = chrono::steady_clock::now();
+        if (!tree.create(storage) || parser.loadTree(path, tree) != 0)
+        {
+            cout << "Mapped tree test: loading " << path << " failed.\n";
+            return;
+        }
+        auto timer_loaded = chrono::steady_clock::now();
+
+        dom_parser::DOMnodeUID count = tree.getNodeCount();
+        size_t bytes = 0;
+        tree.advise(true);
+        auto timer_sequential = chrono::steady_clock::now();
+        for (dom_parser::DOMnodeUID uid = 0; uid < count; ++uid)
+            bytes += tree.getNode(uid).getTagName().size() + tree.getNode(uid).getInnerData().size();
+        auto timer_random = chrono::steady_clock::now();
+        tree.advise(false);
+        testRandom random;
+        for (dom_parser::DOMnodeUID i = 0; i < count; ++i)
+        {
+            dom_parser::DOMnodeUID uid = random.below(count);
+            bytes -= tree.getNode(uid).getTagName().size() + tree.getNode(uid).getInnerData().size();
+        }
+        auto timer_stop = chrono::steady_clock::now();
+
+        cout << "Mapped tree of " << path << " (" << count << " nodes, checksum " << bytes << "): loaded in "
+             << chrono::duration_cast<chrono::microseconds>(timer_loaded - timer_start).count() << " us, sequential walk "
+             << chrono::duration_cast<chrono::microseconds>(timer_random - timer_sequential).count() << " us, random walk "
+             << chrono::duration_cast<chrono::microseconds>(timer_stop - timer_random).count() << " us.\n";
+    }
+} mappedTreeTest;
+#endif